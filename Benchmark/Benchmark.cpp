@@ -0,0 +1,608 @@
+// Microbenchmarks for TofuMath.h
+//
+// usage: TofuMathBenchmark [--json file] [--sizes 16,256,4096] [--filter name] [--min-time-ms 20]
+//
+// every primitive runs over arrays of `batch` elements; a run is repeated
+// until it takes at least min-time and the best of several runs is kept
+
+#include "../TofuMath.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define TOFU_BENCH_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TOFU_BENCH_TSC 1
+#endif
+
+using namespace tofu::math;
+
+namespace
+{
+	struct Result
+	{
+		std::string	name;
+		size_t		batch;
+		size_t		bytesPerOp;
+		double		nsPerOp;
+		double		cyclesPerOp;
+	};
+
+	struct Options
+	{
+		std::vector<size_t>	sizes;
+		const char*			jsonPath;
+		const char*			filter;
+		double				minTimeMs;
+	};
+
+	// keeps the optimizer from dropping results that are never read
+	inline void escape(const void* p)
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		static const void* volatile sink;
+		sink = p;
+		_ReadWriteBarrier();
+#else
+		asm volatile("" : : "g"(p) : "memory");
+#endif
+	}
+
+	inline uint64_t cycles()
+	{
+#if defined(TOFU_BENCH_TSC)
+		return __rdtsc();
+#else
+		return 0;
+#endif
+	}
+
+	const char* simd_path()
+	{
+#if defined(TOFU_MATH_AVX2)
+		return "avx2";
+#elif defined(TOFU_MATH_SSE2)
+		return "sse2";
+#else
+		return "scalar";
+#endif
+	}
+
+	uint32_t rngState = 0x12345678u;
+
+	float random_float(float lo, float hi)
+	{
+		rngState ^= rngState << 13;
+		rngState ^= rngState >> 17;
+		rngState ^= rngState << 5;
+		return lo + (hi - lo) * float(rngState & 0xffffff) / float(0xffffff);
+	}
+
+	float4 random_quat()
+	{
+		return quatNormalize(float4{
+			random_float(-1.0f, 1.0f), random_float(-1.0f, 1.0f),
+			random_float(-1.0f, 1.0f), random_float(-1.0f, 1.0f) });
+	}
+
+	float4x4 random_matrix()
+	{
+		float4 q = random_quat();
+		float3 t{ random_float(-10.0f, 10.0f), random_float(-10.0f, 10.0f), random_float(-10.0f, 10.0f) };
+		return translate(t) * rotate(q) * scale(random_float(0.5f, 2.0f));
+	}
+
+	// input data shared by all benchmarks, sized for the largest batch
+	struct Data
+	{
+		std::vector<float4x4>	m4a, m4b, m4out;
+		std::vector<float3x4>	m3a, m3b, m3out;
+		std::vector<float4>		v4a, v4out;
+		std::vector<float3>		v3a, v3out, scales;
+		std::vector<float4>		qa, qb, qout;
+		std::vector<float>		t, x, y, z, ox, oy, oz;
+		std::vector<uint32_t>	index;
+		std::vector<float3>		aos;
+		std::vector<dualquat>	dq, dqout;
+		std::vector<int4>		bones;
+		std::vector<float4>		weights;
+		std::vector<uint16_t>	u16;
+		std::vector<int16_t>	s16;
+		std::vector<uint8_t>	u8;
+		std::vector<uint32_t>	packed, q32;
+		std::vector<quat48>		q48;
+		std::vector<aabb>		boxes;
+		std::vector<sphere>		spheres;
+		frustum					view;
+
+		void init(size_t n)
+		{
+			m4a.resize(n); m4b.resize(n); m4out.resize(n);
+			m3a.resize(n); m3b.resize(n); m3out.resize(n);
+			v4a.resize(n); v4out.resize(n);
+			v3a.resize(n); v3out.resize(n); scales.resize(n);
+			qa.resize(n); qb.resize(n); qout.resize(n);
+			t.resize(n); x.resize(n); y.resize(n); z.resize(n);
+			ox.resize(n); oy.resize(n); oz.resize(n);
+			index.resize(n);
+			dq.resize(n); dqout.resize(n);
+			bones.resize(n); weights.resize(n);
+			u16.resize(n); s16.resize(n); u8.resize(n); packed.resize(n);
+			boxes.resize(n); spheres.resize(n);
+			q32.resize(n); q48.resize(n);
+			view = frustumFromMatrix(perspective(1.5f, 1.0f, 0.1f, 100.0f));
+			// SkinnedVertex sized records, position first
+			aos.resize(n * 8);
+
+			for (size_t i = 0; i < n; i++)
+			{
+				m4a[i] = random_matrix();
+				m4b[i] = random_matrix();
+				m3a[i] = toFloat3x4(m4a[i]);
+				m3b[i] = toFloat3x4(m4b[i]);
+				v4a[i] = float4{ random_float(-1.0f, 1.0f), random_float(-1.0f, 1.0f), random_float(-1.0f, 1.0f), 1.0f };
+				v3a[i] = float3{ v4a[i].x, v4a[i].y, v4a[i].z };
+				qa[i] = random_quat();
+				qb[i] = random_quat();
+				t[i] = random_float(0.0f, 1.0f);
+				x[i] = v4a[i].x;
+				y[i] = v4a[i].y;
+				z[i] = v4a[i].z;
+				index[i] = uint32_t(i * 7919) % uint32_t(n);
+				aos[i * 8] = v3a[i];
+				dq[i] = toDualQuat(qa[i], v3a[i]);
+				bones[i] = int4{ int32_t(index[i]), int32_t((i * 31) % n), int32_t((i * 17) % n), int32_t(i) };
+				weights[i] = float4{ 0.4f, 0.3f, 0.2f, 0.1f };
+				q32[i] = packQuat32(qa[i]);
+				q48[i] = packQuat48(qa[i]);
+				scales[i] = float3{ random_float(0.5f, 2.0f), random_float(0.5f, 2.0f), random_float(0.5f, 2.0f) };
+				// spread over the view volume so all three classifications occur
+				float3 c = v3a[i] * 4.0f + float3{ 0.0f, 0.0f, 3.0f };
+				float3 e{ t[i], t[i], t[i] };
+				boxes[i] = aabb{ c - e, c + e };
+				spheres[i] = sphere{ c, t[i] };
+			}
+		}
+	};
+
+	class Runner
+	{
+	public:
+		explicit Runner(const Options& options) : options(options) {}
+
+		// body(batch) performs `batch` operations
+		template<typename Body>
+		void run(const char* name, size_t bytesPerOp, Body body)
+		{
+			if (nullptr != options.filter && nullptr == strstr(name, options.filter))
+				return;
+
+			for (size_t batch : options.sizes)
+			{
+				size_t iterations = 1;
+				double ns = 0.0;
+				uint64_t cy = 0;
+
+				// calibrate, then keep the best of five timed runs
+				while (time(body, batch, iterations, ns, cy) < options.minTimeMs * 1e6 && iterations < (size_t(1) << 40))
+				{
+					iterations *= 2;
+				}
+
+				double bestNs = ns;
+				uint64_t bestCycles = cy;
+				for (uint32_t r = 0; r < 5; r++)
+				{
+					time(body, batch, iterations, ns, cy);
+					if (ns < bestNs)
+					{
+						bestNs = ns;
+						bestCycles = cy;
+					}
+				}
+
+				double ops = double(iterations) * double(batch);
+				Result result{ name, batch, bytesPerOp, bestNs / ops, double(bestCycles) / ops };
+				print(result);
+				results.push_back(result);
+			}
+		}
+
+		int32_t write_json(const char* path) const
+		{
+			FILE* f = fopen(path, "w");
+			if (nullptr == f)
+				return -1;
+
+			fprintf(f, "{\n  \"simd\": \"%s\",\n  \"tsc\": %s,\n  \"results\": [\n",
+				simd_path(), cycles() != 0 ? "true" : "false");
+			for (size_t i = 0; i < results.size(); i++)
+			{
+				const Result& r = results[i];
+				fprintf(f, "    { \"name\": \"%s\", \"batch\": %zu, \"bytes_per_op\": %zu, \"ns_per_op\": %.4f, \"cycles_per_op\": %.4f, \"bytes_per_cycle\": %.4f }%s\n",
+					r.name.c_str(), r.batch, r.bytesPerOp, r.nsPerOp, r.cyclesPerOp,
+					r.cyclesPerOp > 0.0 ? double(r.bytesPerOp) / r.cyclesPerOp : 0.0,
+					i + 1 < results.size() ? "," : "");
+			}
+			fprintf(f, "  ]\n}\n");
+			fclose(f);
+			return 0;
+		}
+
+	private:
+		template<typename Body>
+		static double time(Body& body, size_t batch, size_t iterations, double& ns, uint64_t& cy)
+		{
+			auto start = std::chrono::steady_clock::now();
+			uint64_t c0 = cycles();
+			for (size_t i = 0; i < iterations; i++)
+			{
+				body(batch);
+			}
+			uint64_t c1 = cycles();
+			auto end = std::chrono::steady_clock::now();
+			ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+			cy = c1 - c0;
+			return ns;
+		}
+
+		static void print(const Result& r)
+		{
+			printf("%-28s %8zu %10.3f ns/op %10.3f B/cycle\n",
+				r.name.c_str(), r.batch, r.nsPerOp,
+				r.cyclesPerOp > 0.0 ? double(r.bytesPerOp) / r.cyclesPerOp : 0.0);
+		}
+
+		const Options&		options;
+		std::vector<Result>	results;
+	};
+
+	void run_all(Runner& runner, Data& d)
+	{
+		// float4x4
+
+		runner.run("float4x4*float4x4", sizeof(float4x4) * 3, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.m4out[i] = d.m4a[i] * d.m4b[i];
+			escape(d.m4out.data());
+		});
+
+		runner.run("float4*float4x4", sizeof(float4) * 2 + sizeof(float4x4), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.v4out[i] = d.v4a[i] * d.m4a[i];
+			escape(d.v4out.data());
+		});
+
+		runner.run("float4x4*float4", sizeof(float4) * 2 + sizeof(float4x4), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.v4out[i] = d.m4a[i] * d.v4a[i];
+			escape(d.v4out.data());
+		});
+
+		runner.run("inverse(float4x4)", sizeof(float4x4) * 2, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.m4out[i] = inverse(d.m4a[i]);
+			escape(d.m4out.data());
+		});
+
+		runner.run("inverse(float4x4[])", sizeof(float4x4) * 2, [&](size_t n) {
+			inverse(d.m4a.data(), d.m4out.data(), n);
+			escape(d.m4out.data());
+		});
+
+		runner.run("rotate", sizeof(float4) + sizeof(float4x4), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.m4out[i] = rotate(d.qa[i]);
+			escape(d.m4out.data());
+		});
+
+		runner.run("perspective", sizeof(float) * 2 + sizeof(float4x4), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.m4out[i] = perspective(d.t[i] + 0.5f, 1.5f, d.x[i] + 2.0f, 100.0f);
+			escape(d.m4out.data());
+		});
+
+		// float3x4
+
+		runner.run("float3x4*float3x4", sizeof(float3x4) * 3, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.m3out[i] = d.m3a[i] * d.m3b[i];
+			escape(d.m3out.data());
+		});
+
+		runner.run("transformPoint", sizeof(float3) * 2 + sizeof(float3x4), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.v3out[i] = transformPoint(d.m3a[i], d.v3a[i]);
+			escape(d.v3out.data());
+		});
+
+		runner.run("inverse(float3x4)", sizeof(float3x4) * 2, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.m3out[i] = inverse(d.m3a[i]);
+			escape(d.m3out.data());
+		});
+
+		runner.run("inverse(float3x4[])", sizeof(float3x4) * 2, [&](size_t n) {
+			inverse(d.m3a.data(), d.m3out.data(), n);
+			escape(d.m3out.data());
+		});
+
+		runner.run("inverseRigid(float3x4[])", sizeof(float3x4) * 2, [&](size_t n) {
+			inverseRigid(d.m3a.data(), d.m3out.data(), n);
+			escape(d.m3out.data());
+		});
+
+		// batched transforms
+
+		runner.run("transformPoints", sizeof(float) * 6, [&](size_t n) {
+			transformPoints(d.m3a[0], d.x.data(), d.y.data(), d.z.data(), d.ox.data(), d.oy.data(), d.oz.data(), n);
+			escape(d.ox.data());
+		});
+
+		runner.run("transformPoints(strided)", sizeof(float) * 6, [&](size_t n) {
+			transformPoints(d.m3a[0], d.aos.data(), sizeof(float3) * 8, d.ox.data(), d.oy.data(), d.oz.data(), n);
+			escape(d.ox.data());
+		});
+
+		runner.run("transformPointsIndexed", sizeof(float) * 6 + sizeof(uint32_t), [&](size_t n) {
+			transformPointsIndexed(d.m3a.data(), d.index.data(), d.x.data(), d.y.data(), d.z.data(), d.ox.data(), d.oy.data(), d.oz.data(), n);
+			escape(d.ox.data());
+		});
+
+		// vectors
+
+		runner.run("normalize(float3)", sizeof(float3) * 2, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.v3out[i] = normalize(d.v3a[i]);
+			escape(d.v3out.data());
+		});
+
+		runner.run("fast::normalize(float3)", sizeof(float3) * 2, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.v3out[i] = fast::normalize(d.v3a[i]);
+			escape(d.v3out.data());
+		});
+
+		runner.run("normalize(float4)", sizeof(float4) * 2, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.v4out[i] = normalize(d.v4a[i]);
+			escape(d.v4out.data());
+		});
+
+		runner.run("fast::normalize(float4)", sizeof(float4) * 2, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.v4out[i] = fast::normalize(d.v4a[i]);
+			escape(d.v4out.data());
+		});
+
+		runner.run("fast::sincos", sizeof(float) * 3, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) fast::sincos(d.x[i] * 10.0f, d.ox[i], d.oy[i]);
+			escape(d.ox.data());
+		});
+
+		// quaternions
+
+		runner.run("quat", sizeof(float) * 4 + sizeof(float4), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.qout[i] = quat(d.t[i], d.v3a[i]);
+			escape(d.qout.data());
+		});
+
+		runner.run("quatMul", sizeof(float4) * 3, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.qout[i] = quatMul(d.qa[i], d.qb[i]);
+			escape(d.qout.data());
+		});
+
+		runner.run("quatMul[]", sizeof(float4) * 3, [&](size_t n) {
+			quatMul(d.qa.data(), d.qb.data(), d.qout.data(), n);
+			escape(d.qout.data());
+		});
+
+		runner.run("nlerp", sizeof(float4) * 3 + sizeof(float), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.qout[i] = nlerp(d.qa[i], d.qb[i], d.t[i]);
+			escape(d.qout.data());
+		});
+
+		runner.run("nlerp[]", sizeof(float4) * 3 + sizeof(float), [&](size_t n) {
+			nlerp(d.qa.data(), d.qb.data(), d.t.data(), d.qout.data(), n);
+			escape(d.qout.data());
+		});
+
+		runner.run("slerp", sizeof(float4) * 3 + sizeof(float), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.qout[i] = slerp(d.qa[i], d.qb[i], d.t[i]);
+			escape(d.qout.data());
+		});
+
+		runner.run("slerpApprox", sizeof(float4) * 3 + sizeof(float), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.qout[i] = slerpApprox(d.qa[i], d.qb[i], d.t[i]);
+			escape(d.qout.data());
+		});
+
+		runner.run("slerpApprox[]", sizeof(float4) * 3 + sizeof(float), [&](size_t n) {
+			slerpApprox(d.qa.data(), d.qb.data(), d.t.data(), d.qout.data(), n);
+			escape(d.qout.data());
+		});
+
+		runner.run("rotate(float4[])", sizeof(float4) + sizeof(float3x4), [&](size_t n) {
+			rotate(d.qa.data(), d.m3out.data(), n);
+			escape(d.m3out.data());
+		});
+
+		// dual quaternions
+
+		runner.run("toDualQuat(float3x4[])", sizeof(float3x4) + sizeof(dualquat), [&](size_t n) {
+			toDualQuat(d.m3a.data(), d.dqout.data(), n);
+			escape(d.dqout.data());
+		});
+
+		runner.run("blend(dualquat)", sizeof(int4) + sizeof(float4) + sizeof(dualquat) * 5, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.dqout[i] = blend(d.dq.data(), d.bones[i], d.weights[i]);
+			escape(d.dqout.data());
+		});
+
+		runner.run("blend(dualquat[])", sizeof(int4) + sizeof(float4) + sizeof(dualquat) * 5, [&](size_t n) {
+			blend(d.dq.data(), d.bones.data(), d.weights.data(), d.dqout.data(), n);
+			escape(d.dqout.data());
+		});
+
+		runner.run("transformPoints(dualquat[])", sizeof(float) * 6 + sizeof(dualquat), [&](size_t n) {
+			transformPoints(d.dq.data(), d.x.data(), d.y.data(), d.z.data(), d.ox.data(), d.oy.data(), d.oz.data(), n);
+			escape(d.ox.data());
+		});
+
+		runner.run("floatToHalf[]", sizeof(float) + sizeof(uint16_t), [&](size_t n) {
+			floatToHalf(d.x.data(), d.u16.data(), n);
+			escape(d.u16.data());
+		});
+
+		runner.run("halfToFloat[]", sizeof(float) + sizeof(uint16_t), [&](size_t n) {
+			halfToFloat(d.u16.data(), d.ox.data(), n);
+			escape(d.ox.data());
+		});
+
+		runner.run("packSnorm16[]", sizeof(float) + sizeof(int16_t), [&](size_t n) {
+			packSnorm16(d.x.data(), d.s16.data(), n);
+			escape(d.s16.data());
+		});
+
+		runner.run("unpackSnorm16[]", sizeof(float) + sizeof(int16_t), [&](size_t n) {
+			unpackSnorm16(d.s16.data(), d.ox.data(), n);
+			escape(d.ox.data());
+		});
+
+		runner.run("packUnorm8[]", sizeof(float) + sizeof(uint8_t), [&](size_t n) {
+			packUnorm8(d.t.data(), d.u8.data(), n);
+			escape(d.u8.data());
+		});
+
+		runner.run("packUnorm1010102[]", sizeof(float4) + sizeof(uint32_t), [&](size_t n) {
+			packUnorm1010102(d.weights.data(), d.packed.data(), n);
+			escape(d.packed.data());
+		});
+
+		runner.run("packOctahedral[]", sizeof(float) * 3 + sizeof(uint32_t), [&](size_t n) {
+			packOctahedral(d.x.data(), d.y.data(), d.z.data(), d.packed.data(), n);
+			escape(d.packed.data());
+		});
+
+		runner.run("unpackOctahedral[]", sizeof(float) * 3 + sizeof(uint32_t), [&](size_t n) {
+			unpackOctahedral(d.packed.data(), d.ox.data(), d.oy.data(), d.oz.data(), n);
+			escape(d.ox.data());
+		});
+
+		runner.run("unpackQuat32", sizeof(uint32_t) + sizeof(float4), [&](size_t n) {
+			for (size_t i = 0; i < n; i++) d.qout[i] = unpackQuat32(d.q32[i]);
+			escape(d.qout.data());
+		});
+
+		runner.run("unpackQuat32[]", sizeof(uint32_t) + sizeof(float4), [&](size_t n) {
+			unpackQuat32(d.q32.data(), d.qout.data(), n);
+			escape(d.qout.data());
+		});
+
+		runner.run("unpackQuat48[]", sizeof(quat48) + sizeof(float4), [&](size_t n) {
+			unpackQuat48(d.q48.data(), d.qout.data(), n);
+			escape(d.qout.data());
+		});
+
+		runner.run("classify(aabb)", sizeof(aabb) + sizeof(uint8_t), [&](size_t n) {
+			for (size_t i = 0; i < n; i++)
+				d.u8[i] = uint8_t(classify(d.view, d.boxes[i]));
+			escape(d.u8.data());
+		});
+
+		runner.run("classify(aabb[])", sizeof(aabb) + sizeof(uint8_t), [&](size_t n) {
+			classify(d.view, d.boxes.data(), d.u8.data(), n);
+			escape(d.u8.data());
+		});
+
+		runner.run("decompose(float3x4[])", sizeof(float3x4) + sizeof(float3) * 2 + sizeof(float4), [&](size_t n) {
+			decompose(d.m3a.data(), d.v3out.data(), d.qout.data(), d.scales.data(), n);
+			escape(d.qout.data());
+		});
+
+		runner.run("compose(float3x4[])", sizeof(float3x4) + sizeof(float3) * 2 + sizeof(float4), [&](size_t n) {
+			compose(d.v3a.data(), d.qa.data(), d.scales.data(), d.m3out.data(), n);
+			escape(d.m3out.data());
+		});
+
+		runner.run("classify(sphere[])", sizeof(sphere) + sizeof(uint8_t), [&](size_t n) {
+			classify(d.view, d.spheres.data(), d.u8.data(), n);
+			escape(d.u8.data());
+		});
+	}
+
+	bool parse_options(int argc, char** argv, Options& options)
+	{
+		options.sizes = { 16, 256, 4096, 65536 };
+		options.jsonPath = nullptr;
+		options.filter = nullptr;
+		options.minTimeMs = 20.0;
+
+		for (int i = 1; i < argc; i++)
+		{
+			const char* arg = argv[i];
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+			if (0 == strcmp(arg, "--json") && value)
+			{
+				options.jsonPath = value;
+				i++;
+			}
+			else if (0 == strcmp(arg, "--filter") && value)
+			{
+				options.filter = value;
+				i++;
+			}
+			else if (0 == strcmp(arg, "--min-time-ms") && value)
+			{
+				options.minTimeMs = atof(value);
+				i++;
+			}
+			else if (0 == strcmp(arg, "--sizes") && value)
+			{
+				options.sizes.clear();
+				for (const char* p = value; *p != '\0';)
+				{
+					char* next = nullptr;
+					size_t size = size_t(strtoull(p, &next, 10));
+					if (next == p || size == 0)
+						return false;
+					options.sizes.push_back(size);
+					p = (*next == ',') ? next + 1 : next;
+				}
+				i++;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		return !options.sizes.empty();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parse_options(argc, argv, options))
+	{
+		fprintf(stderr, "usage: %s [--json file] [--sizes 16,256,4096] [--filter name] [--min-time-ms 20]\n", argv[0]);
+		return 1;
+	}
+
+	size_t maxBatch = 0;
+	for (size_t size : options.sizes)
+		maxBatch = size > maxBatch ? size : maxBatch;
+
+	Data data;
+	data.init(maxBatch);
+
+	printf("TofuMath benchmark, %s path%s\n", simd_path(),
+		cycles() != 0 ? "" : ", no cycle counter");
+
+	Runner runner(options);
+	run_all(runner, data);
+
+	if (nullptr != options.jsonPath && 0 != runner.write_json(options.jsonPath))
+	{
+		fprintf(stderr, "cannot write %s\n", options.jsonPath);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,489 @@
+// Headless batch converter
+//
+// usage: TofuConvert [-j threads] [-f] [-w epsilon] [-a archive] <input dir> <output dir>
+//
+// every file below the input directory that Assimp can read is converted
+// to a .tfm file at the same relative path below the output directory.
+// Next to each output a .stamp file records the importer version, format
+// version and options it was made with. Outputs newer than their source
+// with a matching stamp are skipped unless -f is given. Inputs that only
+// differ in their extension would share an output, the first in name
+// order is converted and the others fail. Files are spread over a
+// work-stealing pool, one Assimp::Importer per worker.
+// Identical vertices are welded, or with -w those within epsilon, and
+// meshes are reordered for the vertex cache and vertex fetch.
+// With -a the files converted in this run are appended to an archive,
+// named by their path below the output directory
+
+#include "../TofuConvert.h"
+#include "../TofuArchive.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+using namespace tofu;
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	struct Job
+	{
+		std::string	input;
+		std::string	output;
+		uint64_t	size;
+	};
+
+	// the jobs of one worker, the owner takes from the back and thieves
+	// from the front
+	struct WorkQueue
+	{
+		std::mutex				lock;
+		std::deque<uint32_t>	jobs;
+	};
+
+	struct Stats
+	{
+		std::mutex				lock;
+		uint32_t				converted;
+		uint32_t				failed;
+		uint64_t				welded;		// vertices removed
+		std::vector<uint8_t>	succeeded;	// per job
+	};
+
+	// time is in the finest unit the platform offers, only compared
+	bool file_info(const std::string& path, int64_t& time, uint64_t& size, bool& directory)
+	{
+#ifdef _WIN32
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data))
+			return false;
+		directory = 0 != (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+		time = int64_t((uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime);
+		size = (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+#else
+		struct stat st;
+		if (0 != stat(path.c_str(), &st))
+			return false;
+		directory = S_ISDIR(st.st_mode);
+#ifdef __linux__
+		time = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+		time = int64_t(st.st_mtime);
+#endif
+		size = uint64_t(st.st_size);
+#endif
+		return true;
+	}
+
+	void list_directory(const std::string& dir, std::vector<std::string>& names)
+	{
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA((dir + "/*").c_str(), &data);
+		if (INVALID_HANDLE_VALUE == find)
+			return;
+		do
+		{
+			names.push_back(data.cFileName);
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+#else
+		DIR* d = opendir(dir.c_str());
+		if (nullptr == d)
+			return;
+		while (dirent* ent = readdir(d))
+			names.push_back(ent->d_name);
+		closedir(d);
+#endif
+	}
+
+	// creates every missing directory on the way to the file at path
+	void make_parent_directories(const std::string& path)
+	{
+		for (size_t pos = path.find_first_of("/\\", 1); pos != std::string::npos; pos = path.find_first_of("/\\", pos + 1))
+		{
+			std::string dir = path.substr(0, pos);
+#ifdef _WIN32
+			CreateDirectoryA(dir.c_str(), nullptr);
+#else
+			mkdir(dir.c_str(), 0755);
+#endif
+		}
+	}
+
+	bool replace_file(const std::string& from, const std::string& to)
+	{
+#ifdef _WIN32
+		return 0 != MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+		return 0 == rename(from.c_str(), to.c_str());
+#endif
+	}
+
+	// what an output depends on besides its source, the weld epsilon is
+	// written by its bits so any change is seen
+	std::string make_stamp(float weldEpsilon)
+	{
+		uint32_t epsilon;
+		memcpy(&epsilon, &weldEpsilon, sizeof(epsilon));
+		char stamp[64];
+		snprintf(stamp, sizeof(stamp), "importer %u model %u weld %08x\n", importerVersion, TFModelVersion, epsilon);
+		return stamp;
+	}
+
+	std::string stamp_path(const std::string& output)
+	{
+		return output + ".stamp";
+	}
+
+	bool read_stamp(const std::string& path, std::string& stamp)
+	{
+		FILE* file = fopen(path.c_str(), "rb");
+		if (nullptr == file)
+			return false;
+		char buffer[64];
+		size_t size = fread(buffer, 1, sizeof(buffer), file);
+		fclose(file);
+		stamp.assign(buffer, size);
+		return true;
+	}
+
+	bool write_stamp(const std::string& path, const std::string& stamp)
+	{
+		FILE* file = fopen(path.c_str(), "wb");
+		if (nullptr == file)
+			return false;
+		bool ok = 1 == fwrite(stamp.data(), stamp.size(), 1, file);
+		return 0 == fclose(file) && ok;
+	}
+
+	// the key two outputs collide on, file names ignore case on Windows
+	std::string output_key(std::string name)
+	{
+#ifdef _WIN32
+		for (char& c : name)
+			c = char(tolower(static_cast<unsigned char>(c)));
+#endif
+		return name;
+	}
+
+	void find_jobs(const std::string& inDir, const std::string& outDir, bool force, const std::string& stamp,
+		const Assimp::Importer& importer, std::vector<Job>& jobs, uint32_t& upToDate, uint32_t& collided)
+	{
+		std::vector<std::string> names;
+		list_directory(inDir, names);
+		std::sort(names.begin(), names.end());
+
+		// output name to the input converted to it
+		std::map<std::string, std::string> outputs;
+
+		for (const std::string& name : names)
+		{
+			if (name == "." || name == "..")
+				continue;
+
+			std::string input = inDir + "/" + name;
+			int64_t inTime;
+			uint64_t inSize;
+			bool directory;
+			if (!file_info(input, inTime, inSize, directory))
+				continue;
+
+			if (directory)
+			{
+				find_jobs(input, outDir + "/" + name, force, stamp, importer, jobs, upToDate, collided);
+				continue;
+			}
+
+			size_t dot = name.find_last_of('.');
+			if (dot == std::string::npos || !importer.IsExtensionSupported(name.c_str() + dot))
+				continue;
+
+			std::string outName = name.substr(0, dot) + ".tfm";
+			auto first = outputs.insert(std::make_pair(output_key(outName), name));
+			if (!first.second)
+			{
+				collided++;
+				printf("    FAILED     %s: same output as %s/%s\n", input.c_str(), inDir.c_str(), first.first->second.c_str());
+				continue;
+			}
+
+			std::string output = outDir + "/" + outName;
+			int64_t outTime;
+			uint64_t outSize;
+			std::string outStamp;
+			if (!force && file_info(output, outTime, outSize, directory) && outTime >= inTime &&
+				read_stamp(stamp_path(output), outStamp) && outStamp == stamp)
+			{
+				upToDate++;
+				continue;
+			}
+
+			jobs.push_back(Job{ input, output, inSize });
+		}
+	}
+
+	bool next_job(std::vector<WorkQueue>& queues, uint32_t self, uint32_t& job)
+	{
+		{
+			WorkQueue& q = queues[self];
+			std::lock_guard<std::mutex> guard(q.lock);
+			if (!q.jobs.empty())
+			{
+				job = q.jobs.back();
+				q.jobs.pop_back();
+				return true;
+			}
+		}
+
+		// no job is ever added once the workers start, so empty queues
+		// everywhere means done
+		for (uint32_t i = 1; i < queues.size(); i++)
+		{
+			WorkQueue& q = queues[(self + i) % queues.size()];
+			std::lock_guard<std::mutex> guard(q.lock);
+			if (!q.jobs.empty())
+			{
+				job = q.jobs.front();
+				q.jobs.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// what a conversion did besides writing the output
+	struct Report
+	{
+		uint32_t			welded;
+		VertexCacheStats	before;
+		VertexCacheStats	after;
+	};
+
+	// written next to the output and renamed into place, so an interrupted
+	// run never leaves a partial file that looks up to date. The stamp is
+	// written last, an output without it is converted again
+	int32_t convert(Assimp::Importer& importer, const Job& job, uint32_t numThreads, float weldEpsilon,
+		const std::string& stamp, Report& report, std::string& error)
+	{
+		const aiScene* scene = importer.ReadFile(job.input.c_str(), importFlags);
+		if (nullptr == scene)
+		{
+			error = importer.GetErrorString();
+			return -1;
+		}
+
+		ConvertedModel model;
+		int32_t ret = convert_scene(scene, model, numThreads);
+		importer.FreeScene();
+		if (0 != ret)
+		{
+			error = "conversion failed";
+			return -1;
+		}
+
+		report.welded = weld_meshes(model.vertices, model.indices, model.meshes, weldEpsilon, numThreads);
+		report.before = vertex_cache_stats(model.indices, model.meshes);
+		optimize_meshes(model.vertices, model.indices, model.meshes, vertexCacheSize, numThreads);
+		report.after = vertex_cache_stats(model.indices, model.meshes);
+
+		make_parent_directories(job.output);
+		std::string temp = job.output + ".tmp";
+		remove(stamp_path(job.output).c_str());
+		if (0 != write_model(temp.c_str(), model_data(model)) || !replace_file(temp, job.output) ||
+			!write_stamp(stamp_path(job.output), stamp))
+		{
+			remove(temp.c_str());
+			error = "cannot write " + job.output;
+			return -1;
+		}
+		return 0;
+	}
+
+	// with fewer files than threads each conversion gets a share of the
+	// threads left over, so one large scene still uses the machine
+	void worker(std::vector<WorkQueue>& queues, uint32_t self, const std::vector<Job>& jobs,
+		uint32_t convertThreads, float weldEpsilon, const std::string& stamp, Stats& stats)
+	{
+		Assimp::Importer importer;
+
+		uint32_t job;
+		while (next_job(queues, self, job))
+		{
+			std::string error;
+			Report report = {};
+			Clock::time_point start = Clock::now();
+			int32_t ret = convert(importer, jobs[job], convertThreads, weldEpsilon, stamp, report, error);
+			double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			std::lock_guard<std::mutex> guard(stats.lock);
+			if (0 == ret)
+			{
+				stats.converted++;
+				stats.welded += report.welded;
+				stats.succeeded[job] = 1;
+				printf("%10.1f ms  %s, %u vertices welded, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+					ms, jobs[job].input.c_str(), report.welded,
+					report.before.acmr(), report.after.acmr(), report.before.atvr(), report.after.atvr());
+			}
+			else
+			{
+				stats.failed++;
+				printf("    FAILED     %s: %s\n", jobs[job].input.c_str(), error.c_str());
+			}
+			fflush(stdout);
+		}
+	}
+
+	bool read_file(const std::string& path, std::vector<char>& data)
+	{
+		FILE* file = fopen(path.c_str(), "rb");
+		if (nullptr == file)
+			return false;
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		data.resize(size > 0 ? size_t(size) : 0);
+		bool ok = size > 0 && 1 == fread(data.data(), data.size(), 1, file);
+		fclose(file);
+		return ok;
+	}
+
+	// a batch of files per append, bounding the memory held at once
+	int32_t pack(const char* archive, const std::string& outDir, const std::vector<Job>& jobs, const Stats& stats)
+	{
+		const uint32_t batchSize = 64;
+
+		std::vector<std::vector<char>> data;
+		std::vector<std::string> names;
+		for (uint32_t i = 0; i < jobs.size(); i++)
+		{
+			if (stats.succeeded[i])
+			{
+				data.push_back(std::vector<char>());
+				names.push_back(jobs[i].output.substr(outDir.size() + 1));
+				if (!read_file(jobs[i].output, data.back()))
+					return -1;
+			}
+
+			if (data.size() == batchSize || (i + 1 == jobs.size() && !data.empty()))
+			{
+				std::vector<ArchiveItem> items;
+				for (uint32_t j = 0; j < data.size(); j++)
+					items.push_back(ArchiveItem{ names[j].c_str(), data[j].data(), uint32_t(data[j].size()) });
+				if (0 != append_archive(archive, items.data(), uint32_t(items.size())))
+					return -1;
+				data.clear();
+				names.clear();
+			}
+		}
+		return 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t numThreads = std::thread::hardware_concurrency();
+	bool force = false;
+	float weldEpsilon = 0.0f;
+	const char* archive = nullptr;
+	const char* inDir = nullptr;
+	const char* outDir = nullptr;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (0 == strcmp(argv[i], "-j") && i + 1 < argc)
+			numThreads = uint32_t(atoi(argv[++i]));
+		else if (0 == strcmp(argv[i], "-f"))
+			force = true;
+		else if (0 == strcmp(argv[i], "-w") && i + 1 < argc)
+			weldEpsilon = float(atof(argv[++i]));
+		else if (0 == strcmp(argv[i], "-a") && i + 1 < argc)
+			archive = argv[++i];
+		else if (nullptr == inDir)
+			inDir = argv[i];
+		else if (nullptr == outDir)
+			outDir = argv[i];
+		else
+			usage = true;
+	}
+
+	if (usage || nullptr == inDir || nullptr == outDir)
+	{
+		fprintf(stderr, "usage: %s [-j threads] [-f] [-w epsilon] [-a archive] <input dir> <output dir>\n", argv[0]);
+		return 2;
+	}
+
+	numThreads = numThreads > 0 ? numThreads : 1;
+
+	Clock::time_point start = Clock::now();
+
+	std::string stamp = make_stamp(weldEpsilon);
+	std::vector<Job> jobs;
+	uint32_t upToDate = 0;
+	uint32_t collided = 0;
+	{
+		Assimp::Importer importer;
+		find_jobs(inDir, outDir, force, stamp, importer, jobs, upToDate, collided);
+	}
+
+	// largest first, dealt round robin, so the long conversions start early
+	// and stealing only has to even out the tail
+	std::vector<uint32_t> order(jobs.size());
+	for (uint32_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return jobs[a].size > jobs[b].size; });
+
+	uint32_t convertThreads = std::max(numThreads / std::max(uint32_t(jobs.size()), 1u), 1u);
+	numThreads = std::min(numThreads, std::max(uint32_t(jobs.size()), 1u));
+	std::vector<WorkQueue> queues(numThreads);
+	for (uint32_t i = 0; i < order.size(); i++)
+		queues[i % numThreads].jobs.push_front(order[i]);
+
+	Stats stats;
+	stats.converted = 0;
+	stats.failed = collided;
+	stats.welded = 0;
+	stats.succeeded.resize(jobs.size());
+
+	std::vector<std::thread> threads;
+	for (uint32_t i = 0; i < numThreads; i++)
+		threads.push_back(std::thread(worker, std::ref(queues), i, std::cref(jobs), convertThreads, weldEpsilon, std::cref(stamp), std::ref(stats)));
+	for (std::thread& t : threads)
+		t.join();
+
+	int32_t packed = 0;
+	if (nullptr != archive && 0 != (packed = pack(archive, outDir, jobs, stats)))
+		fprintf(stderr, "cannot append to %s\n", archive);
+
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	printf("%u converted, %u up to date, %u failed in %.2f s on %u threads, %llu vertices welded\n",
+		stats.converted, upToDate, stats.failed, seconds, numThreads, (unsigned long long)stats.welded);
+
+	return stats.failed > 0 || 0 != packed ? 1 : 0;
+}
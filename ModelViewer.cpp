@@ -1,9 +1,14 @@
 #include "ModelViewer.h"
 
+#include <algorithm>
+#include <cstring>
 #include <string>
 #include <iostream>
+#include <thread>
 
 #include <assimp/Importer.hpp>
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOStream.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
@@ -23,11 +28,146 @@
 using namespace tofu;
 using namespace tofu::math;
 
+namespace
+{
+	const uint64_t importCacheSize = 1ull << 30;
+
+	void count_mesh_uses(const aiNode* node, std::vector<uint32_t>& uses)
+	{
+		for (uint32_t i = 0; i < node->mNumMeshes; i++)
+			uses[node->mMeshes[i]]++;
+		for (uint32_t i = 0; i < node->mNumChildren; i++)
+			count_mesh_uses(node->mChildren[i], uses);
+	}
+
+	// converted meshes carry one transform each, so only scenes drawing
+	// every mesh exactly once look the same from the import cache
+	bool single_instances(const aiScene* scene)
+	{
+		if (nullptr == scene->mRootNode)
+			return false;
+		std::vector<uint32_t> uses(scene->mNumMeshes);
+		count_mesh_uses(scene->mRootNode, uses);
+		return std::all_of(uses.begin(), uses.end(), [](uint32_t n) { return 1 == n; });
+	}
+}
+
+// a file already in memory, read only
+class MemoryStream : public Assimp::IOStream
+{
+public:
+	MemoryStream(const char* data, size_t size) : data(data), size(size), pos(0) {}
+
+	size_t Read(void* buffer, size_t elementSize, size_t count) override
+	{
+		if (0 == elementSize)
+			return 0;
+		count = std::min(count, (size - pos) / elementSize);
+		memcpy(buffer, data + pos, count * elementSize);
+		pos += count * elementSize;
+		return count;
+	}
+
+	size_t Write(const void*, size_t, size_t) override { return 0; }
+
+	// offsets from the end count backwards, as in Assimp's own memory stream
+	aiReturn Seek(size_t offset, aiOrigin origin) override
+	{
+		if (origin == aiOrigin_END)
+		{
+			if (offset > size)
+				return aiReturn_FAILURE;
+			pos = size - offset;
+			return aiReturn_SUCCESS;
+		}
+
+		size_t base = origin == aiOrigin_SET ? 0 : pos;
+		if (offset > size - base)
+			return aiReturn_FAILURE;
+		pos = base + offset;
+		return aiReturn_SUCCESS;
+	}
+
+	size_t Tell() const override { return pos; }
+	size_t FileSize() const override { return size; }
+	void Flush() override {}
+
+private:
+	const char*	data;
+	size_t		size;
+	size_t		pos;
+};
+
+// the file system the importer reads through. The opened file is served
+// from the bytes read for the import cache key, so Assimp parses what was
+// hashed without reading it again. It also notes whether an import looked
+// for any file besides the one opened, such as .mtl files or glTF buffers.
+// Only the opened file is in the key, so imports that read others are not
+// cached
+class ImportIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+	using Assimp::DefaultIOSystem::Exists;
+	using Assimp::DefaultIOSystem::Open;
+
+	ImportIOSystem() : mainData(nullptr), otherFiles(false) {}
+
+	// without data the opened file is read from disk
+	void begin(const char* filename, const std::vector<char>* data)
+	{
+		mainFile = filename;
+		mainData = data;
+		otherFiles = false;
+	}
+
+	bool other_files() const { return otherFiles; }
+
+	bool Exists(const char* file) const override
+	{
+		note(file);
+		return Assimp::DefaultIOSystem::Exists(file);
+	}
+
+	Assimp::IOStream* Open(const char* file, const char* mode = "rb") override
+	{
+		if (nullptr != mainData && 0 == strchr(mode, 'w') && ComparePaths(file, mainFile.c_str()))
+			return new MemoryStream(mainData->data(), mainData->size());
+
+		note(file);
+		return Assimp::DefaultIOSystem::Open(file, mode);
+	}
+
+private:
+	// failed lookups count too, a file added later would change the import
+	void note(const char* file) const
+	{
+		if (!ComparePaths(file, mainFile.c_str()))
+			otherFiles = true;
+	}
+
+	std::string					mainFile;
+	const std::vector<char>*	mainData;
+	mutable bool				otherFiles;
+};
+
 int32_t ModelViewer::init_assets()
 {
 	logBuffer = new ImGuiTextBuffer();
 
 	importer = new Assimp::Importer();
+	importIO = new ImportIOSystem();
+	importer->SetIOHandler(importIO);
+
+	ioQueue = create_io_queue(4);
+	sourceRead.file = IOFile{ -1, 0 };
+	sourceRead.done = false;
+
+	{
+		char path[MAX_PATH] = {};
+		GetModuleFileNameA(nullptr, path, MAX_PATH);
+		importCacheDir = path;
+		importCacheDir = importCacheDir.substr(0, importCacheDir.find_last_of("\\/") + 1) + "ImportCache";
+	}
 
 	do
 	{
@@ -145,8 +285,13 @@ int32_t ModelViewer::init_assets()
 		indexBuffer = nullptr;
 		numVertices = 0;
 		numIndices = 0;
+		vertices.clear();
+		indices.clear();
 		meshes.clear();
 
+		mappedModel = MappedModel();
+		nextChunk = 0;
+
 		return 0;
 
 	} while (0);
@@ -164,8 +309,15 @@ int32_t ModelViewer::init_assets()
 
 void ModelViewer::cleanup_assets()
 {
+	// callbacks write into sourceRead
+	destroy_io_queue(ioQueue);
+	close_io_file(sourceRead.file);
+
 	delete importer;
 
+	release_streamed_meshes();
+	close_model(mappedModel);
+
 	if (nullptr != vertexBuffer) vertexBuffer->Release();
 	if (nullptr != indexBuffer) indexBuffer->Release();
 
@@ -185,6 +337,15 @@ void ModelViewer::update()
 {
 	gui();
 
+	poll_reads(ioQueue);
+	if (sourceRead.done)
+	{
+		sourceRead.done = false;
+		import_model();
+	}
+
+	stream_next_chunk();
+
 	D3D11_MAPPED_SUBRESOURCE res = {};
 	if (S_OK != context->Map(frameCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &res))
 		return;
@@ -192,14 +353,19 @@ void ModelViewer::update()
 	{
 		float4x4* data = reinterpret_cast<float4x4*>(res.pData);
 
-		*data = translate(0.0f, 0.0f, 2.0f);
+		float4x4 view = translate(0.0f, 0.0f, 2.0f);
 
 		float fov = 3.14159f * 0.5f;
 		float aspect = (float)bufferWidth / bufferHeight;
 		float zNear = 0.01f;
 		float zFar = 100.0f;
 
-		*(data + 1) = perspective(fov, aspect, zNear, zFar);
+		float4x4 proj = perspective(fov, aspect, zNear, zFar);
+
+		*data = view;
+		*(data + 1) = proj;
+
+		viewFrustum = frustumFromMatrix(proj * view);
 
 		context->Unmap(frameCB, 0);
 	}
@@ -219,8 +385,10 @@ void ModelViewer::update()
 
 void ModelViewer::render()
 {
-	//render_meshes();
-	render_scene();
+	if (nullptr != scene)
+		render_scene();
+	else
+		render_meshes();
 }
 
 void ModelViewer::gui()
@@ -262,6 +430,54 @@ void ModelViewer::gui_menu()
 				SetCurrentDirectory(cwd);
 			}
 
+			if (ImGui::MenuItem("Export", nullptr, false, can_export()))
+			{
+				wchar_t cwd[1024] = {};
+				wchar_t filename[1024] = {};
+
+				GetCurrentDirectory(1024, cwd);
+
+				OPENFILENAME ofn = {};
+				ofn.lStructSize = sizeof(OPENFILENAME);
+				ofn.hwndOwner = hWnd;
+				ofn.lpstrFile = filename;
+				ofn.nMaxFile = 1024;
+				ofn.lpstrFilter = L"TFModel (*.tfm)\0*.tfm\0";
+				ofn.lpstrDefExt = L"tfm";
+				ofn.Flags = OFN_OVERWRITEPROMPT;
+				if (GetSaveFileName(&ofn))
+				{
+					if (0 != export_model(ofn.lpstrFile, false))
+						logBuffer->append("failed to export model\n");
+				}
+
+				SetCurrentDirectory(cwd);
+			}
+
+			if (ImGui::MenuItem("Export Streaming", nullptr, false, can_export()))
+			{
+				wchar_t cwd[1024] = {};
+				wchar_t filename[1024] = {};
+
+				GetCurrentDirectory(1024, cwd);
+
+				OPENFILENAME ofn = {};
+				ofn.lStructSize = sizeof(OPENFILENAME);
+				ofn.hwndOwner = hWnd;
+				ofn.lpstrFile = filename;
+				ofn.nMaxFile = 1024;
+				ofn.lpstrFilter = L"TFModel (*.tfm)\0*.tfm\0";
+				ofn.lpstrDefExt = L"tfm";
+				ofn.Flags = OFN_OVERWRITEPROMPT;
+				if (GetSaveFileName(&ofn))
+				{
+					if (0 != export_model(ofn.lpstrFile, true))
+						logBuffer->append("failed to export model\n");
+				}
+
+				SetCurrentDirectory(cwd);
+			}
+
 			ImGui::Separator();
 
 			if (ImGui::MenuItem("Quit", "ALT+F4"))
@@ -300,8 +516,31 @@ void ModelViewer::gui_hierarchy()
 
 	do
 	{
+		// models from .tfm files and the import cache keep the node tree
+		// only as their skeleton, with the meshes flattened out of it
 		if (nullptr == scene)
+		{
+			if (bones.empty())
+			{
+				if (!meshes.empty())
+					ImGui::TextUnformatted("no node tree, meshes are flattened");
+				break;
+			}
+
+			gui_skeleton_node(0);
+
+			if (selectedBone >= 0 && selectedBone < int32_t(bones.size()))
+			{
+				ImGui::Separator();
+
+				float* m = bones[selectedBone].matrix;
+
+				ImGui::InputFloat4("r1", m, -1, ImGuiInputTextFlags_ReadOnly);
+				ImGui::InputFloat4("r2", m + 4, -1, ImGuiInputTextFlags_ReadOnly);
+				ImGui::InputFloat4("r3", m + 8, -1, ImGuiInputTextFlags_ReadOnly);
+			}
 			break;
+		}
 
 		gui_hierarchy_node(scene->mRootNode);
 
@@ -361,8 +600,20 @@ void ModelViewer::gui_meshes()
 	if (!ImGui::Begin("Meshes")) return;
 	do
 	{
+		// mesh names are not stored in .tfm files
 		if (nullptr == scene)
+		{
+			for (uint32_t i = 0; i < meshes.size(); ++i)
+			{
+				char nameBuf[64];
+				sprintf(nameBuf, "_unnamed_%u", i);
+				if (ImGui::Selectable(nameBuf, i == selectedMesh))
+				{
+					selectedMesh = i;
+				}
+			}
 			break;
+		}
 
 		for (uint32_t i = 0; i < scene->mNumMeshes; ++i)
 		{
@@ -393,7 +644,26 @@ void ModelViewer::gui_animations()
 
 	do
 	{
-		if (nullptr == scene || !scene->HasAnimations())
+		// nor are animation names
+		if (nullptr == scene)
+		{
+			for (uint32_t i = 0; i < mappedModel.model.numAnims; ++i)
+			{
+				char nameBuf[64];
+				sprintf(nameBuf, "animation %u", i);
+				if (ImGui::Selectable(nameBuf, i == selectedAnimation))
+				{
+					if (selectedAnimation != i && 0 != load_animation(i))
+					{
+						logBuffer->append("failed to load animation\n");
+					}
+					selectedAnimation = i;
+				}
+			}
+			break;
+		}
+
+		if (!scene->HasAnimations())
 			break;
 
 		for (uint32_t i = 0; i < scene->mNumAnimations; ++i)
@@ -420,7 +690,24 @@ void ModelViewer::gui_tracks()
 	ImGui::SetNextWindowSize(ImVec2(200, 600), ImGuiSetCond_FirstUseEver);
 	if (!ImGui::Begin("Tracks")) return;
 
-	if (scene != nullptr && selectedAnimation != -1)
+	if (scene == nullptr && selectedAnimation != -1)
+	{
+		// one track per bone, those without keys are left out as the scene
+		// has no channel for them
+		for (uint32_t i = 0; i < tracks.size() && i < bones.size(); i++)
+		{
+			const Track& t = tracks[i];
+			if (0 == t.numTransFrames && 0 == t.numRotFrames && 0 == t.numScaleFrames)
+				continue;
+
+			ImGui::Text("%s (T: %u, R: %u, S: %u)",
+				&boneNameArray[bones[i].name],
+				t.numTransFrames,
+				t.numRotFrames,
+				t.numScaleFrames);
+		}
+	}
+	else if (scene != nullptr && selectedAnimation != -1)
 	{
 		aiAnimation* a = scene->mAnimations[selectedAnimation];
 		for (uint32_t i = 0; i < a->mNumChannels; i++)
@@ -498,102 +785,400 @@ void ModelViewer::load_model(const wchar_t * filename)
 	std::wstring wfn(filename);
 	std::string fn(wfn.begin(), wfn.end());
 
+	// a read still running for an earlier open finishes and is dropped
+	wait_reads(ioQueue);
+	sourceRead.done = false;
+
 	importer->FreeScene();
+	release_streamed_meshes();
+	close_model(mappedModel);
 	this->scene = nullptr;
 	selectedMesh = -1;
 	selectedAnimation = -1;
 	selectedNode = nullptr;
 
+	if (nullptr != vertexBuffer) vertexBuffer->Release();
+	if (nullptr != indexBuffer) indexBuffer->Release();
 	vertexBuffer = nullptr;
 	indexBuffer = nullptr;
 	numVertices = 0;
 	numIndices = 0;
+	vertices.clear();
+	indices.clear();
 	meshes.clear();
 
-	const aiScene* scene = importer->ReadFile(fn.c_str(), 
-		aiProcess_Triangulate | 
-		aiProcess_GenNormals |
-		aiProcess_CalcTangentSpace |
-		aiProcess_ConvertToLeftHanded);
+	// the skeleton and animation belong to the previous model
+	selectedBone = -1;
+	bones.clear();
+	boneNameArray.clear();
+	boneTable.clear();
+	anim = Animation();
+	tracks.clear();
+	vectorFrames.clear();
+	quatFrames.clear();
+
+	if (fn.size() >= 4 && 0 == _stricmp(fn.c_str() + fn.size() - 4, ".tfm"))
+	{
+		load_tfmodel(fn.c_str());
+		return;
+	}
+
+	// the source is read in the background to key the import cache while
+	// frames go on, import_model continues from update() once it is in
+	sourceRead.filename = fn;
+	sourceRead.result = -1;
+	close_io_file(sourceRead.file);
+	if (0 == open_io_file(fn.c_str(), sourceRead.file) &&
+		sourceRead.file.size > 0 && sourceRead.file.size <= 0xffffffffu)
+	{
+		sourceRead.data.resize(size_t(sourceRead.file.size));
+		ReadRequest r = { &sourceRead.file, 0, sourceRead.data.data(), uint32_t(sourceRead.data.size()),
+			source_read_done, &sourceRead };
+		if (0 == submit_reads(ioQueue, &r, 1))
+			return;
+	}
+
+	import_model();
+}
+
+void ModelViewer::source_read_done(void* user, int64_t result)
+{
+	SourceRead* read = reinterpret_cast<SourceRead*>(user);
+	read->result = result;
+	read->done = true;
+}
+
+void ModelViewer::import_model()
+{
+	// most opens are re-opens of unchanged files, those are served from
+	// the import cache without running Assimp
+	uint64_t importKey = 0;
+	bool sourceIn = !sourceRead.data.empty() && sourceRead.result == int64_t(sourceRead.data.size());
+	if (sourceIn)
+		importKey = import_key(sourceRead.data.data(), sourceRead.data.size(), importFlags, importerVersion);
+	close_io_file(sourceRead.file);
+
+	if (0 != importKey && 0 == cache_lookup(importCacheDir.c_str(), importKey, mappedModel))
+	{
+		std::vector<char>().swap(sourceRead.data);
+		logBuffer->append("loaded from import cache\n");
+		load_mapped_model();
+		return;
+	}
+
+	// Assimp reads the source from memory and opens the files it refers to
+	// itself, a failed background read leaves it all to Assimp
+	importIO->begin(sourceRead.filename.c_str(), sourceIn ? &sourceRead.data : nullptr);
+	const aiScene* scene = importer->ReadFile(sourceRead.filename.c_str(), importFlags);
+	importIO->begin(sourceRead.filename.c_str(), nullptr);
+	std::vector<char>().swap(sourceRead.data);
+	if (importIO->other_files() && 0 != importKey)
+	{
+		logBuffer->append("not cached, the model reads other files\n");
+		importKey = 0;
+	}
 
 	if (scene == nullptr)
 		return;
 
 	this->scene = scene;
 
-	for (uint32_t i = 0; i < scene->mNumMeshes; i++)
+	if (0 != importKey && !single_instances(scene))
 	{
-		aiMesh* m = scene->mMeshes[i];
-		numVertices += m->mNumVertices;
-		numIndices += m->mNumFaces * 3;
+		logBuffer->append("not cached, meshes are drawn by several nodes\n");
+		importKey = 0;
 	}
 
+	// converted the way TofuConvert does, with the skeleton from the root
+	// and every animation, so the cache entry does not depend on what was
+	// selected in the viewer
+	uint32_t numThreads = std::thread::hardware_concurrency();
+	ConvertedModel converted;
+	if (0 != convert_scene(scene, converted, numThreads))
+	{
+		logBuffer->append("failed to convert model\n");
+		return;
+	}
+
+	uint32_t welded = weld_meshes(converted.vertices, converted.indices, converted.meshes, 0.0f, numThreads);
+	logBuffer->append("welded %u of %u vertices\n", welded, uint32_t(converted.vertices.size()) + welded);
+
+	VertexCacheStats before = vertex_cache_stats(converted.indices, converted.meshes);
+	optimize_meshes(converted.vertices, converted.indices, converted.meshes, vertexCacheSize, numThreads);
+	VertexCacheStats after = vertex_cache_stats(converted.indices, converted.meshes);
+	logBuffer->append("vertex cache ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		before.acmr(), after.acmr(), before.atvr(), after.atvr());
+
+	if (0 != importKey && !converted.vertices.empty() &&
+		0 != cache_store(importCacheDir.c_str(), importKey, model_data(converted), importCacheSize))
+		logBuffer->append("failed to write import cache\n");
+
+	// the viewer takes the same skeleton a cache hit would give it
+	vertices.swap(converted.vertices);
+	indices.swap(converted.indices);
+	meshes.swap(converted.meshes);
+	bones.swap(converted.bones);
+	boneNameArray.swap(converted.strings);
+	boneTable.swap(converted.names);
+	numVertices = uint32_t(vertices.size());
+	numIndices = uint32_t(indices.size());
+
 	if (numVertices == 0) return;
 
-	SkinnedVertex* vertices = new SkinnedVertex[numVertices];
-	int32_t* indices = new int32_t[numIndices];
-	uint32_t vid = 0, iid = 0;
-	for (uint32_t i = 0; i < scene->mNumMeshes; i++)
+	do
 	{
-		aiMesh* m = scene->mMeshes[i];
-		for (uint32_t j = 0; j < m->mNumVertices; j++)
+		CD3D11_BUFFER_DESC vbDesc(
+			numVertices * sizeof(SkinnedVertex),
+			D3D11_BIND_VERTEX_BUFFER);
+		D3D11_SUBRESOURCE_DATA vbData = { vertices.data(), 0, 0 };
+		if (S_OK != device->CreateBuffer(&vbDesc, &vbData, &vertexBuffer))
+			break;
+
+		CD3D11_BUFFER_DESC ibDesc(
+			numIndices * sizeof(uint32_t),
+			D3D11_BIND_INDEX_BUFFER);
+		D3D11_SUBRESOURCE_DATA ibData = { indices.data(), 0, 0 };
+		if (S_OK != device->CreateBuffer(&ibDesc, &ibData, &indexBuffer))
+			break;
+
+	} while (0);
+
+	if (nullptr == vertexBuffer || nullptr == indexBuffer)
+	{
+		if (nullptr != vertexBuffer) vertexBuffer->Release();
+		if (nullptr != indexBuffer) indexBuffer->Release();
+		vertexBuffer = nullptr;
+		indexBuffer = nullptr;
+	}
+}
+
+int32_t ModelViewer::export_model(const wchar_t * filename, bool chunked)
+{
+	std::wstring wfn(filename);
+	std::string fn(wfn.begin(), wfn.end());
+
+	ExportData data;
+	if (0 != collect_model(data)) return -1;
+
+	return chunked ? write_model_chunked(fn.c_str(), data.model) : write_model(fn.c_str(), data.model);
+}
+
+bool ModelViewer::can_export() const
+{
+	// the head of a chunked file only has the coarse geometry
+	return nullptr != scene || (nullptr != mappedModel.data && 0 == mappedModel.model.numChunks);
+}
+
+int32_t ModelViewer::collect_model(ExportData& data)
+{
+	if (!can_export()) return -1;
+
+	// a model without a scene is written back as it was loaded
+	if (nullptr == scene)
+	{
+		for (uint32_t i = 0; i < TFSectionCount; i++)
 		{
-			auto& pos = m->mVertices[j];
-			auto& norm = m->mNormals[j];
-			auto& tan = m->mTangents[j];
-			auto& uv = m->mTextureCoords[0][j];
-
-			vertices[vid + j].position = float3{ pos.x, pos.y, pos.z };
-			vertices[vid + j].normal = float3{ norm.x, norm.y, norm.z };
-			vertices[vid + j].tangent = float3{ tan.x, tan.y, tan.z };
-			vertices[vid + j].uv = float3{ uv.x, uv.y, uv.z };
-			//vertices[vid + j].bones.x = m->
+			if (0 != require_section(mappedModel, i))
+			{
+				logBuffer->append("model checksum mismatch\n");
+				return -1;
+			}
 		}
 
-		for (uint32_t j = 0; j < m->mNumFaces; j++)
+		data.model = mappedModel.model;
+		return 0;
+	}
+
+	if (vertices.empty()) return -1;
+
+	// tracks are per bone, so animations are only exported with a skeleton.
+	// Imports get one from the root, or the one built with Generate Skeleton
+	if (bones.empty() && scene->mNumAnimations > 0)
+		logBuffer->append("no skeleton, animations are not exported\n");
+	if (!bones.empty())
+	{
+		for (uint32_t i = 0; i < scene->mNumAnimations; i++)
 		{
-			indices[iid + j * 3] = m->mFaces[j].mIndices[0];
-			indices[iid + j * 3 + 1] = m->mFaces[j].mIndices[1];
-			indices[iid + j * 3 + 2] = m->mFaces[j].mIndices[2];
+			Animation a = Animation();
+			if (0 != convert_animation(scene->mAnimations[i], uint32_t(bones.size()), boneTable,
+				a, data.tracks, data.vectorFrames, data.quatFrames))
+				return -1;
+			data.anims.push_back(a);
 		}
+	}
+
+	ModelData& model = data.model;
+	model = ModelData();
+	model.vertices = vertices.data();
+	model.numVertices = uint32_t(vertices.size());
+	model.indices = indices.data();
+	model.numIndices = uint32_t(indices.size());
+	model.meshes = meshes.data();
+	model.numMeshes = uint32_t(meshes.size());
+	model.bones = bones.data();
+	model.numBones = uint32_t(bones.size());
+	model.anims = data.anims.data();
+	model.numAnims = uint32_t(data.anims.size());
+	model.tracks = data.tracks.data();
+	model.numTracks = uint32_t(data.tracks.size());
+	model.vectorFrames = data.vectorFrames.data();
+	model.numVectorFrames = uint32_t(data.vectorFrames.size());
+	model.quatFrames = data.quatFrames.data();
+	model.numQuatFrames = uint32_t(data.quatFrames.size());
+	model.strings = boneNameArray.data();
+	model.stringSize = uint32_t(boneNameArray.size());
+	model.names = boneTable.data();
+	model.numNameSlots = uint32_t(boneTable.size());
+
+	return 0;
+}
+
+int32_t ModelViewer::load_tfmodel(const char * filename)
+{
+	// files picked by hand may come from anywhere, so their checksums are
+	// checked, cache entries were written by this program and are not
+	if (0 != open_model(filename, mappedModel, true))
+	{
+		logBuffer->append("failed to open model\n");
+		return -1;
+	}
+
+	return load_mapped_model();
+}
 
-		Mesh mesh;
-		mesh.startVertex = vid;
-		mesh.startIndex = iid;
-		mesh.numVertices = m->mNumVertices;
-		mesh.numIndices = m->mNumFaces * 3;
-		meshes.push_back(mesh);
+int32_t ModelViewer::load_mapped_model()
+{
+	// every way out without buffers closes the model, so update() never
+	// streams chunks of it into an empty streamedMeshes
+	const ModelData& model = mappedModel.model;
+	if (0 == model.numVertices || 0 == model.numIndices)
+	{
+		release_streamed_meshes();
+		close_model(mappedModel);
+		return 0;
+	}
 
-		vid += m->mNumVertices;
-		iid += m->mNumFaces * 3;
+	if (0 != require_section(mappedModel, TFSectionMeshes) ||
+		0 != require_section(mappedModel, TFSectionBones) ||
+		0 != require_section(mappedModel, TFSectionStrings) ||
+		0 != require_section(mappedModel, TFSectionNames) ||
+		0 != require_section(mappedModel, TFSectionVertices) ||
+		0 != require_section(mappedModel, TFSectionIndices))
+	{
+		logBuffer->append("model checksum mismatch\n");
+		release_streamed_meshes();
+		close_model(mappedModel);
+		return -1;
 	}
 
+	// the small tables the viewer works on are copied, vertex and index
+	// data go from the mapped pages straight to the GPU
+	meshes.assign(model.meshes, model.meshes + model.numMeshes);
+	bones.assign(model.bones, model.bones + model.numBones);
+	boneNameArray.assign(model.strings, model.strings + model.stringSize);
+	boneTable.assign(model.names, model.names + model.numNameSlots);
+	numVertices = model.numVertices;
+	numIndices = model.numIndices;
+
 	do
 	{
 		CD3D11_BUFFER_DESC vbDesc(
 			numVertices * sizeof(SkinnedVertex),
 			D3D11_BIND_VERTEX_BUFFER);
-		D3D11_SUBRESOURCE_DATA vbData = { vertices, 0, 0 };
+		D3D11_SUBRESOURCE_DATA vbData = { model.vertices, 0, 0 };
 		if (S_OK != device->CreateBuffer(&vbDesc, &vbData, &vertexBuffer))
 			break;
 
 		CD3D11_BUFFER_DESC ibDesc(
 			numIndices * sizeof(uint32_t),
 			D3D11_BIND_INDEX_BUFFER);
-		D3D11_SUBRESOURCE_DATA ibData = { indices, 0, 0 };
+		D3D11_SUBRESOURCE_DATA ibData = { model.indices, 0, 0 };
 		if (S_OK != device->CreateBuffer(&ibDesc, &ibData, &indexBuffer))
 			break;
 
 	} while (0);
 
-	delete[] vertices;
-	delete[] indices;
-
 	if (nullptr == vertexBuffer || nullptr == indexBuffer)
 	{
 		if (nullptr != vertexBuffer) vertexBuffer->Release();
 		if (nullptr != indexBuffer) indexBuffer->Release();
+		vertexBuffer = nullptr;
+		indexBuffer = nullptr;
+		release_streamed_meshes();
+		close_model(mappedModel);
+		return -1;
 	}
+
+	// meshes so far point at the coarse head geometry, the full detail
+	// chunks follow in update()
+	streamedMeshes.assign(meshes.size(), StreamedMesh());
+	prefetch_chunk(mappedModel, 0);
+
+	return 0;
+}
+
+void ModelViewer::stream_next_chunk()
+{
+	const ModelData& model = mappedModel.model;
+	while (nextChunk < model.numChunks && model.chunks[nextChunk].type != TFChunkGeometry)
+		nextChunk++;
+	if (nextChunk >= model.numChunks) return;
+
+	uint32_t chunkIndex = nextChunk++;
+	const TFChunk& chunk = model.chunks[chunkIndex];
+	prefetch_chunk(mappedModel, nextChunk);
+
+	GeometryChunk geometry;
+	if (0 != require_chunk(mappedModel, chunkIndex) ||
+		0 != validate_chunk(mappedModel.data, chunk, geometry))
+	{
+		logBuffer->append("invalid geometry chunk\n");
+		return;
+	}
+	if (0 == geometry.numVertices || 0 == geometry.numIndices) return;
+	if (chunk.index >= streamedMeshes.size())
+	{
+		logBuffer->append("geometry chunk of a missing mesh\n");
+		return;
+	}
+
+	StreamedMesh& streamed = streamedMeshes[chunk.index];
+
+	do
+	{
+		CD3D11_BUFFER_DESC vbDesc(
+			geometry.numVertices * sizeof(SkinnedVertex),
+			D3D11_BIND_VERTEX_BUFFER);
+		D3D11_SUBRESOURCE_DATA vbData = { geometry.vertices, 0, 0 };
+		if (S_OK != device->CreateBuffer(&vbDesc, &vbData, &streamed.vertexBuffer))
+			break;
+
+		CD3D11_BUFFER_DESC ibDesc(
+			geometry.numIndices * sizeof(uint32_t),
+			D3D11_BIND_INDEX_BUFFER);
+		D3D11_SUBRESOURCE_DATA ibData = { geometry.indices, 0, 0 };
+		if (S_OK != device->CreateBuffer(&ibDesc, &ibData, &streamed.indexBuffer))
+			break;
+
+		streamed.numIndices = geometry.numIndices;
+		return;
+
+	} while (0);
+
+	if (nullptr != streamed.vertexBuffer) streamed.vertexBuffer->Release();
+	if (nullptr != streamed.indexBuffer) streamed.indexBuffer->Release();
+	streamed = StreamedMesh();
+}
+
+void ModelViewer::release_streamed_meshes()
+{
+	for (StreamedMesh& streamed : streamedMeshes)
+	{
+		if (nullptr != streamed.vertexBuffer) streamed.vertexBuffer->Release();
+		if (nullptr != streamed.indexBuffer) streamed.indexBuffer->Release();
+	}
+	streamedMeshes.clear();
+	nextChunk = 0;
 }
 
 void ModelViewer::render_meshes()
@@ -616,11 +1201,40 @@ void ModelViewer::render_meshes()
 	ID3D11Buffer* cbs[] = { instanceCB, frameCB };
 	context->VSSetConstantBuffers(0, 2, cbs);
 
+	float4x4 root = root_transform();
+
 	for (uint32_t i = 0; i < meshes.size(); i++)
 	{
 		Mesh& m = meshes[i];
 
-		context->DrawIndexed(m.numIndices, m.startIndex, m.startVertex);
+		float4x4 world = root * toFloat4x4(reinterpret_cast<const float3x4&>(m.matrix));
+
+		if (Outside == classify(viewFrustum, transformAabb(world, m.bounds)))
+			continue;
+
+		D3D11_MAPPED_SUBRESOURCE res = {};
+		if (S_OK == context->Map(instanceCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &res))
+		{
+			float4x4* data = reinterpret_cast<float4x4*>(res.pData);
+
+			*(data) = world;
+
+			context->Unmap(instanceCB, 0);
+		}
+
+		if (i < streamedMeshes.size() && nullptr != streamedMeshes[i].vertexBuffer)
+		{
+			StreamedMesh& streamed = streamedMeshes[i];
+			context->IASetVertexBuffers(0, 1, &streamed.vertexBuffer, strides, offsets);
+			context->IASetIndexBuffer(streamed.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+			context->DrawIndexed(streamed.numIndices, 0, 0);
+		}
+		else
+		{
+			context->IASetVertexBuffers(0, 1, &vertexBuffer, strides, offsets);
+			context->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+			context->DrawIndexed(m.numIndices, m.startIndex, m.startVertex);
+		}
 	}
 }
 
@@ -644,31 +1258,41 @@ void ModelViewer::render_scene()
 	ID3D11Buffer* cbs[] = { instanceCB, frameCB };
 	context->VSSetConstantBuffers(0, 2, cbs);
 
-	render_scene_node(scene->mRootNode, translate(0.0f, -1.0f, 0.0f) * 
-		rotate(quat(3.14159f * totalTime, float3{0.0f, 1.0f, 0.0f})) *
-		scale(0.01f));
+	render_scene_node(scene->mRootNode, root_transform());
+}
+
+float4x4 ModelViewer::root_transform() const
+{
+	return translate(0.0f, -1.0f, 0.0f) *
+		rotate(quat(3.14159f * totalTime, float3{ 0.0f, 1.0f, 0.0f })) *
+		scale(0.01f);
 }
 
 void ModelViewer::render_scene_node(aiNode * node, float4x4 parentTransform)
 {
 	float4x4 current = parentTransform * reinterpret_cast<float4x4&>(node->mTransformation);
 
-	if (node->mNumMeshes > 0)
+	bool instanceSet = false;
+	for (uint32_t i = 0; i < node->mNumMeshes; i++)
 	{
-		D3D11_MAPPED_SUBRESOURCE res = {};
-		if (S_OK == context->Map(instanceCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &res))
+		Mesh& m = meshes[node->mMeshes[i]];
+
+		if (Outside == classify(viewFrustum, transformAabb(current, m.bounds)))
+			continue;
+
+		if (!instanceSet)
 		{
-			float4x4* data = reinterpret_cast<float4x4*>(res.pData);
+			D3D11_MAPPED_SUBRESOURCE res = {};
+			if (S_OK == context->Map(instanceCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &res))
+			{
+				float4x4* data = reinterpret_cast<float4x4*>(res.pData);
 
-			*(data) = current;
+				*(data) = current;
 
-			context->Unmap(instanceCB, 0);
+				context->Unmap(instanceCB, 0);
+			}
+			instanceSet = true;
 		}
-	}
-
-	for (uint32_t i = 0; i < node->mNumMeshes; i++)
-	{
-		Mesh& m = meshes[node->mMeshes[i]];
 
 		context->DrawIndexed(m.numIndices, m.startIndex, m.startVertex);
 	}
@@ -682,92 +1306,18 @@ void ModelViewer::render_scene_node(aiNode * node, float4x4 parentTransform)
 int32_t ModelViewer::generate_skeleton(aiNode * node)
 {
 	selectedBone = -1;
-	bones.clear();
-	boneNameArray.clear();
-	boneTable.clear();
-
-	aiNode* root = node;
-
-	{
-		aiNode* p = node->mParent;
-		while (p)
-		{
-			std::string nodeName = p->mName.C_Str();
-			if (nodeName.find("_$AssimpFbx$_") == std::string::npos)
-				break;
-
-			root = p;
-			p = p->mParent;
-		}
-	}
-
-	return generate_skeleton_node(root, -1);
-}
 
-int32_t ModelViewer::generate_skeleton_node(aiNode * node, int32_t parentBoneIdx)
-{
-	std::string nodeName = node->mName.C_Str();
-	aiMatrix4x4 matrix = node->mTransformation;
-
-	size_t pos = nodeName.find("_$AssimpFbx$_");
-	if (pos != std::string::npos)
+	if (0 != convert_skeleton(node, bones, boneNameArray, boneTable))
 	{
-		nodeName = nodeName.substr(0, pos);
-
-		while (node->mNumChildren == 1)
-		{
-			aiNode* n = node->mChildren[0];
-			std::string nName = n->mName.C_Str();
-			if (nName == nodeName ||
-				nName.find(nodeName + "_$AssimpFbx$_") != std::string::npos)
-			{
-				matrix = matrix * n->mTransformation;
-				node = n;
-				continue;
-			}
-			break;
-		}
+		logBuffer->append("duplicate bone names\n");
+		return -1;
 	}
 
-	int32_t boneId = int32_t(bones.size());
-	bones.push_back(Bone());
-	Bone& bone = bones[boneId];
-	bone.parent = parentBoneIdx;
-	bone.firstChild = -1;
-	bone.nextSibling = -1;
-
-	bone.name = int32_t(boneNameArray.size());
-	boneNameArray.resize(boneNameArray.size() + nodeName.length() + 1);
-	strcpy(&boneNameArray[bone.name], nodeName.c_str());
-
-	assert(boneTable.find(nodeName) == boneTable.end());
-	boneTable.insert(std::pair<std::string, int32_t>(nodeName, boneId));
-
-	for (uint32_t i = 0; i < 3; i++)
-		for (uint32_t j = 0; j < 4; j++)
-			bone.matrix[i * 4 + j] = matrix[i][j];
-
-	int32_t lastChild = -1;
-	for (uint32_t i = 0; i < node->mNumChildren; ++i)
-	{
-		int32_t bId = generate_skeleton_node(node->mChildren[i], boneId);
-
-		Bone& bone = bones[boneId];
-		if (bone.firstChild == -1)
-			bone.firstChild = bId;
-		else
-			bones[lastChild].nextSibling = bId;
-
-		lastChild = bId;
-	}
-
-	return boneId;
+	return 0;
 }
 
-int32_t ModelViewer::generate_animation(aiAnimation* a)
+int32_t ModelViewer::create_bones_buffer()
 {
-	if (nullptr == a) return -1;
-
 	if (nullptr != bonesCB)
 	{
 		bonesCB->Release();
@@ -788,67 +1338,85 @@ int32_t ModelViewer::generate_animation(aiAnimation* a)
 		}
 	}
 
-	anim = Animation();
-	anim.frameRate = a->mTicksPerSecond == 0.0 ? 1.0f : float(a->mTicksPerSecond);
-	anim.duration = float(a->mDuration);
-	anim.numTracks = a->mNumChannels;
+	return 0;
+}
 
-	tracks.clear();
-	tracks.resize(bones.size());
+int32_t ModelViewer::generate_animation(aiAnimation* a)
+{
+	if (nullptr == a) return -1;
+
+	if (0 != create_bones_buffer())
+	{
+		return -1;
+	}
 
+	anim = Animation();
+	tracks.clear();
 	vectorFrames.clear();
 	quatFrames.clear();
 
-	for (uint32_t i = 0; i < a->mNumChannels; ++i)
+	return convert_animation(a, uint32_t(bones.size()), boneTable, anim, tracks, vectorFrames, quatFrames);
+}
+
+int32_t ModelViewer::load_animation(uint32_t index)
+{
+	const ModelData& model = mappedModel.model;
+	if (index >= model.numAnims || 0 != require_section(mappedModel, TFSectionAnims))
+		return -1;
+
+	if (0 != create_bones_buffer())
 	{
-		auto& ch = a->mChannels[i];
-		std::string nodeName(ch->mNodeName.C_Str());
-		size_t pos = nodeName.find("_$AssimpFbx$_");
-		if (pos != std::string::npos)
-		{
-			nodeName = nodeName.substr(0, pos);
-		}
+		return -1;
+	}
 
-		if (boneTable.find(nodeName) == boneTable.end())
-			continue;
-		
-		Track& t = tracks[boneTable[nodeName]];
-		
-		t.numTransFrames = ch->mNumPositionKeys;
-		t.transFrames = uint32_t(vectorFrames.size());
-		for (uint32_t f = 0; f < t.numTransFrames; f++)
-		{
-			auto& k = ch->mPositionKeys[f];
-			
-			vectorFrames.push_back(VectorFrame{
-				float3{ k.mValue.x, k.mValue.y, k.mValue.z},
-				float(k.mTime)
-			});
-		}
+	anim = Animation();
+	tracks.clear();
+	vectorFrames.clear();
+	quatFrames.clear();
 
-		t.numRotFrames = ch->mNumRotationKeys;
-		t.rotFrames = uint32_t(quatFrames.size());
-		for (uint32_t f = 0; f < t.numRotFrames; f++)
-		{
-			auto& k = ch->mRotationKeys[f];
-			
-			quatFrames.push_back(QuaternionFrame{
-				float4{ k.mValue.x, k.mValue.y, k.mValue.z, k.mValue.w },
-				float(k.mTime)
-			});
-		}
+	// tracks and frames are in the sections, or in a chunk of their own
+	// with chunk local indices in a chunked file
+	const Animation& a = model.anims[index];
+	AnimationChunk frames = {};
+	if (0 == model.numChunks)
+	{
+		if (0 != require_section(mappedModel, TFSectionTracks) ||
+			0 != require_section(mappedModel, TFSectionVectorFrames) ||
+			0 != require_section(mappedModel, TFSectionQuatFrames))
+			return -1;
 
-		t.numScaleFrames = ch->mNumScalingKeys;
-		t.scaleFrames = uint32_t(vectorFrames.size());
-		for (uint32_t f = 0; f < t.numScaleFrames; f++)
-		{
-			auto& k = ch->mScalingKeys[f];
+		frames.tracks = model.tracks + a.tracks;
+		frames.vectorFrames = model.vectorFrames;
+		frames.quatFrames = model.quatFrames;
+	}
+	else
+	{
+		uint32_t chunk = 0;
+		while (chunk < model.numChunks &&
+			(model.chunks[chunk].type != TFChunkAnimation || model.chunks[chunk].index != index))
+			chunk++;
+		if (chunk == model.numChunks ||
+			0 != require_chunk(mappedModel, chunk) ||
+			0 != validate_chunk(mappedModel.data, model.chunks[chunk], frames) ||
+			frames.numTracks < a.numTracks)
+			return -1;
+	}
 
-			vectorFrames.push_back(VectorFrame{
-				float3{ k.mValue.x, k.mValue.y, k.mValue.z },
-				float(k.mTime)
-			});
-		}
+	anim = a;
+	anim.tracks = 0;
+	tracks.assign(frames.tracks, frames.tracks + a.numTracks);
+	for (Track& t : tracks)
+	{
+		uint32_t transFrames = uint32_t(vectorFrames.size());
+		vectorFrames.insert(vectorFrames.end(), frames.vectorFrames + t.transFrames, frames.vectorFrames + t.transFrames + t.numTransFrames);
+		uint32_t scaleFrames = uint32_t(vectorFrames.size());
+		vectorFrames.insert(vectorFrames.end(), frames.vectorFrames + t.scaleFrames, frames.vectorFrames + t.scaleFrames + t.numScaleFrames);
+		uint32_t rotFrames = uint32_t(quatFrames.size());
+		quatFrames.insert(quatFrames.end(), frames.quatFrames + t.rotFrames, frames.quatFrames + t.rotFrames + t.numRotFrames);
+
+		t.transFrames = transFrames;
+		t.scaleFrames = scaleFrames;
+		t.rotFrames = rotFrames;
 	}
 
 	return 0;
@@ -1,9 +1,10 @@
 #pragma once
 
 #include "Application.h"
-#include "TofuMesh.h"
+#include "TofuCache.h"
+#include "TofuConvert.h"
+#include "TofuIO.h"
 #include <vector>
-#include <unordered_map>
 #include <string>
 
 struct aiScene;
@@ -12,19 +13,28 @@ struct aiAnimation;
 struct ImGuiTextBuffer;
 
 using tofu::math::float4x4;
+using tofu::math::frustum;
 using tofu::Mesh;
+using tofu::SkinnedVertex;
 using tofu::Bone;
 using tofu::Vertex;
 using tofu::VectorFrame;
 using tofu::QuaternionFrame;
 using tofu::Track;
 using tofu::Animation;
+using tofu::ModelData;
+using tofu::MappedModel;
+using tofu::TFNameSlot;
+using tofu::IOQueue;
+using tofu::IOFile;
 
 namespace Assimp
 {
 	class Importer;
 }
 
+class ImportIOSystem;
+
 class ModelViewer : public Application
 {
 protected:
@@ -36,6 +46,7 @@ protected:
 
 private:
 	Assimp::Importer* importer;
+	ImportIOSystem* importIO;	// owned by importer
 	const aiScene* scene;
 
 	int32_t selectedMesh;
@@ -69,6 +80,34 @@ private:
 
 	void load_model(const wchar_t* filename);
 
+	// the rest of load_model for files Assimp reads, once the source is in
+	void import_model();
+
+	static void source_read_done(void* user, int64_t result);
+
+	int32_t export_model(const wchar_t* filename, bool chunked);
+
+	int32_t load_tfmodel(const char* filename);
+
+	// creates the buffers and tables of the model in mappedModel
+	int32_t load_mapped_model();
+
+	// a ModelData over the loaded meshes and skeleton, with the animations
+	// of the scene converted into the arrays below
+	struct ExportData
+	{
+		ModelData						model;
+		std::vector<Animation>			anims;
+		std::vector<Track>				tracks;
+		std::vector<VectorFrame>		vectorFrames;
+		std::vector<QuaternionFrame>	quatFrames;
+	};
+
+	int32_t collect_model(ExportData& data);
+
+	// a scene, or a mapped model whose full detail geometry is in the head
+	bool can_export() const;
+
 private:
 	ID3D11VertexShader*	vertexShader;
 	ID3D11PixelShader*	pixelShader;
@@ -82,15 +121,56 @@ private:
 	uint32_t			numVertices;
 	uint32_t			numIndices;
 
+	std::vector<SkinnedVertex>	vertices;
+	std::vector<uint32_t>		indices;
+
+	// set while a .tfm file is open, meshes and buffers were made from it
+	MappedModel			mappedModel;
+
+	// converted imports keyed by source contents and import flags,
+	// next to the executable
+	std::string			importCacheDir;
+
+	// file reads of the viewer, callbacks run in update()
+	IOQueue*			ioQueue;
+
+	// the source of the import in progress, read to key the import cache
+	// and then parsed from memory
+	struct SourceRead
+	{
+		std::string			filename;
+		IOFile				file;
+		std::vector<char>	data;
+		int64_t				result;
+		bool				done;
+	};
+
+	SourceRead			sourceRead;
+
+	// full detail buffers of a chunked .tfm, one geometry chunk is uploaded
+	// per frame and the coarse head meshes are drawn until it arrives
+	struct StreamedMesh
+	{
+		ID3D11Buffer*	vertexBuffer;
+		ID3D11Buffer*	indexBuffer;
+		uint32_t		numIndices;
+	};
+
+	std::vector<StreamedMesh>	streamedMeshes;
+	uint32_t			nextChunk;
+
 	std::vector<Mesh>	meshes;
 	std::vector<Bone>	bones;
-	std::unordered_map<std::string, int32_t> boneTable;
+	// bone name hashes, see TFNameSlot
+	std::vector<TFNameSlot>	boneTable;
 
 	std::vector<char>	boneNameArray;
 
 	ID3D11Buffer*		instanceCB;
 	ID3D11Buffer*		frameCB;
 
+	frustum				viewFrustum;
+
 	ID3D11Buffer*		bonesCB;
 
 	Animation			anim;
@@ -104,12 +184,22 @@ private:
 	void render_scene();
 	void render_scene_node(aiNode* node, float4x4 parentTransform);
 
+	float4x4 root_transform() const;
+
+	void stream_next_chunk();
+
+	void release_streamed_meshes();
+
 	int32_t generate_skeleton(aiNode* node);
 
-	int32_t generate_skeleton_node(aiNode* node, int32_t parentBoneIdx);
+	int32_t create_bones_buffer();
 
 	int32_t generate_animation(aiAnimation* anim);
 
+	// the animation of the mapped model, with the tracks and frames copied
+	// into anim, tracks, vectorFrames and quatFrames as generate_animation does
+	int32_t load_animation(uint32_t index);
+
 	int32_t compile_shader(const char* src, uint32_t size, const char* entry, const char* target, ID3DBlob** blob);
 	int32_t load_file_to_blob(const wchar_t* filename, ID3DBlob** blob);
 };
\ No newline at end of file
@@ -0,0 +1,404 @@
+#include "TofuArchive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	using namespace tofu;
+
+#ifdef _WIN32
+	typedef HANDLE NativeFile;
+	const NativeFile invalidFile = INVALID_HANDLE_VALUE;
+
+	// readers let a writer in, appends never touch what they look at, and
+	// the writer keeps a second one out
+	NativeFile open_file(const char* filename, bool write)
+	{
+		return CreateFileA(filename, write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+			write ? FILE_SHARE_READ | FILE_SHARE_DELETE : FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, write ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	}
+
+	void close_file(NativeFile file)
+	{
+		CloseHandle(file);
+	}
+
+	uint64_t file_size(NativeFile file)
+	{
+		LARGE_INTEGER size = {};
+		return GetFileSizeEx(file, &size) ? uint64_t(size.QuadPart) : 0;
+	}
+
+	// synchronous positioned transfers through the OVERLAPPED offset
+	bool read_at(NativeFile file, uint64_t offset, void* buffer, size_t size)
+	{
+		OVERLAPPED o = {};
+		o.Offset = DWORD(offset);
+		o.OffsetHigh = DWORD(offset >> 32);
+		DWORD done = 0;
+		return size <= 0xffffffffu && ReadFile(file, buffer, DWORD(size), &done, &o) && done == size;
+	}
+
+	bool write_at(NativeFile file, uint64_t offset, const void* buffer, size_t size)
+	{
+		OVERLAPPED o = {};
+		o.Offset = DWORD(offset);
+		o.OffsetHigh = DWORD(offset >> 32);
+		DWORD done = 0;
+		return size <= 0xffffffffu && WriteFile(file, buffer, DWORD(size), &done, &o) && done == size;
+	}
+
+	bool sync_file(NativeFile file)
+	{
+		return 0 != FlushFileBuffers(file);
+	}
+
+	bool extend_file(NativeFile file, uint64_t size)
+	{
+		LARGE_INTEGER end = {};
+		end.QuadPart = LONGLONG(size);
+		return SetFilePointerEx(file, end, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+	}
+#else
+	typedef int NativeFile;
+	const NativeFile invalidFile = -1;
+
+	NativeFile open_file(const char* filename, bool write)
+	{
+		return write ? open(filename, O_RDWR | O_CREAT, 0644) : open(filename, O_RDONLY);
+	}
+
+	void close_file(NativeFile file)
+	{
+		close(file);
+	}
+
+	uint64_t file_size(NativeFile file)
+	{
+		struct stat st;
+		return 0 == fstat(file, &st) ? uint64_t(st.st_size) : 0;
+	}
+
+	bool read_at(NativeFile file, uint64_t offset, void* buffer, size_t size)
+	{
+		char* p = reinterpret_cast<char*>(buffer);
+		while (size > 0)
+		{
+			ssize_t n = pread(file, p, size, off_t(offset));
+			if (n <= 0)
+				return false;
+			p += n;
+			offset += uint64_t(n);
+			size -= size_t(n);
+		}
+		return true;
+	}
+
+	bool write_at(NativeFile file, uint64_t offset, const void* buffer, size_t size)
+	{
+		const char* p = reinterpret_cast<const char*>(buffer);
+		while (size > 0)
+		{
+			ssize_t n = pwrite(file, p, size, off_t(offset));
+			if (n <= 0)
+				return false;
+			p += n;
+			offset += uint64_t(n);
+			size -= size_t(n);
+		}
+		return true;
+	}
+
+	bool sync_file(NativeFile file)
+	{
+		return 0 == fsync(file);
+	}
+
+	bool extend_file(NativeFile file, uint64_t size)
+	{
+		return 0 == ftruncate(file, off_t(size));
+	}
+#endif
+
+	uint64_t align(uint64_t offset, uint64_t alignment)
+	{
+		return (offset + alignment - 1) & ~(alignment - 1);
+	}
+
+	uint32_t header_crc(const TFArchive& header)
+	{
+		TFArchive h = header;
+		h.headerCrc = 0;
+		return crc32c(&h, sizeof(TFArchive));
+	}
+
+	// the header alone, before the table of contents is read
+	bool check_header(const TFArchive& header, uint64_t size)
+	{
+		if (header.magic != TFArchiveMagic || header.version != TFArchiveVersion ||
+			header.headerCrc != header_crc(header) || header.fileSize > size)
+			return false;
+
+		uint64_t tocSize = uint64_t(header.numEntries) * sizeof(TFArchiveEntry) + header.namesSize;
+		return header.tocStart >= sizeof(TFArchive) && header.tocStart % TFModelAlignment == 0 &&
+			header.tocStart + tocSize == header.fileSize;
+	}
+
+	bool check_toc(const TFArchive& header, const TFArchiveEntry* entries, const char* names)
+	{
+		uint64_t tocSize = uint64_t(header.numEntries) * sizeof(TFArchiveEntry) + header.namesSize;
+		if (header.tocCrc != crc32c(entries, size_t(tocSize)))
+			return false;
+
+		if (header.namesSize > 0 && names[header.namesSize - 1] != 0)
+			return false;
+
+		for (uint32_t i = 0; i < header.numEntries; i++)
+		{
+			const TFArchiveEntry& e = entries[i];
+			if (e.offset % TFArchiveAlignment != 0 || e.offset < sizeof(TFArchive) ||
+				e.offset + e.size > header.tocStart || e.name >= header.namesSize ||
+				(i > 0 && entries[i - 1].hash > e.hash))
+				return false;
+		}
+		return true;
+	}
+
+	// the header and the table of contents, entries and names are one read
+	// into a block as check_toc needs them contiguous, then split
+	bool read_index(NativeFile file, TFArchive& header, ArchiveIndex& index)
+	{
+		if (!read_at(file, 0, &header, sizeof(TFArchive)) || !check_header(header, file_size(file)))
+			return false;
+
+		std::vector<TFArchiveEntry> block((header.fileSize - header.tocStart + sizeof(TFArchiveEntry) - 1) / sizeof(TFArchiveEntry));
+		if (!read_at(file, header.tocStart, block.data(), size_t(header.fileSize - header.tocStart)))
+			return false;
+
+		const char* names = reinterpret_cast<const char*>(block.data() + header.numEntries);
+		if (!check_toc(header, block.data(), names))
+			return false;
+
+		index.entries.assign(block.begin(), block.begin() + header.numEntries);
+		index.names.assign(names, names + header.namesSize);
+		return true;
+	}
+
+	struct PendingEntry
+	{
+		uint64_t		hash;
+		std::string		name;
+		uint64_t		offset;
+		uint32_t		size;
+	};
+}
+
+namespace tofu
+{
+	int32_t append_archive(const char* filename, const ArchiveItem* items, uint32_t count)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			ModelData model;
+			if (nullptr == items[i].name || 0 != validate_model(items[i].data, items[i].size, model))
+				return -1;
+		}
+
+		NativeFile file = open_file(filename, true);
+		if (invalidFile == file)
+			return -1;
+
+		int32_t ret = -1;
+		do
+		{
+			// the current table of contents, none for a new file
+			TFArchive header = {};
+			std::vector<PendingEntry> entries;
+			if (file_size(file) > 0)
+			{
+				ArchiveIndex index;
+				if (!read_index(file, header, index))
+					break;
+
+				for (const TFArchiveEntry& e : index.entries)
+					entries.push_back(PendingEntry{ e.hash, &index.names[e.name], e.offset, e.size });
+			}
+			else
+			{
+				header.magic = TFArchiveMagic;
+				header.version = TFArchiveVersion;
+				header.fileSize = sizeof(TFArchive);
+			}
+
+			// new entries go after the old table of contents, which becomes
+			// unused space, so nothing a reader may be looking at is touched
+			uint64_t offset = header.fileSize;
+			bool written = true;
+			for (uint32_t i = 0; i < count && written; i++)
+			{
+				const ArchiveItem& item = items[i];
+				uint64_t hash = hash_name(item.name);
+				offset = align(offset, TFArchiveAlignment);
+				written = write_at(file, offset, item.data, item.size);
+
+				auto same = std::find_if(entries.begin(), entries.end(),
+					[&](const PendingEntry& e) { return e.hash == hash && e.name == item.name; });
+				if (same != entries.end())
+					*same = PendingEntry{ hash, item.name, offset, item.size };
+				else
+					entries.push_back(PendingEntry{ hash, item.name, offset, item.size });
+				offset += item.size;
+			}
+			if (!written)
+				break;
+
+			std::sort(entries.begin(), entries.end(), [](const PendingEntry& a, const PendingEntry& b)
+			{
+				return a.hash != b.hash ? a.hash < b.hash : a.name < b.name;
+			});
+
+			std::vector<TFArchiveEntry> toc(entries.size());
+			std::vector<char> names;
+			for (size_t i = 0; i < entries.size(); i++)
+			{
+				toc[i].hash = entries[i].hash;
+				toc[i].offset = entries[i].offset;
+				toc[i].size = entries[i].size;
+				toc[i].name = uint32_t(names.size());
+				names.insert(names.end(), entries[i].name.begin(), entries[i].name.end());
+				names.push_back(0);
+			}
+
+			// the table of contents is checksummed as one block
+			std::vector<char> block(toc.size() * sizeof(TFArchiveEntry) + names.size());
+			if (!toc.empty())
+				memcpy(block.data(), toc.data(), toc.size() * sizeof(TFArchiveEntry));
+			if (!names.empty())
+				memcpy(block.data() + toc.size() * sizeof(TFArchiveEntry), names.data(), names.size());
+
+			header.tocStart = align(offset, TFModelAlignment);
+			header.numEntries = uint32_t(toc.size());
+			header.namesSize = uint32_t(names.size());
+			header.fileSize = header.tocStart + block.size();
+			header.tocCrc = crc32c(block.data(), block.size());
+			header.headerCrc = header_crc(header);
+
+			// the header switches to the new contents once everything it
+			// points at is on disk. An empty table of contents writes nothing,
+			// so the file is grown to the end the header gives it
+			if (!write_at(file, header.tocStart, block.data(), block.size()) ||
+				(file_size(file) < header.fileSize && !extend_file(file, header.fileSize)) || !sync_file(file) ||
+				!write_at(file, 0, &header, sizeof(TFArchive)) || !sync_file(file))
+				break;
+
+			ret = 0;
+		} while (0);
+
+		close_file(file);
+		return ret;
+	}
+
+	int32_t open_archive(const char* filename, MappedArchive& archive)
+	{
+		archive = MappedArchive();
+
+		MappedFile file;
+		if (0 != map_file(filename, file))
+			return -1;
+
+		const TFArchive& header = *reinterpret_cast<const TFArchive*>(file.data);
+		if (file.size < sizeof(TFArchive) || !check_header(header, file.size))
+		{
+			unmap_file(file);
+			return -1;
+		}
+
+		const uint8_t* base = reinterpret_cast<const uint8_t*>(file.data);
+		const TFArchiveEntry* entries = reinterpret_cast<const TFArchiveEntry*>(base + header.tocStart);
+		const char* names = reinterpret_cast<const char*>(entries + header.numEntries);
+		if (!check_toc(header, entries, names))
+		{
+			unmap_file(file);
+			return -1;
+		}
+
+		archive.data = file.data;
+		archive.size = file.size;
+		archive.entries = entries;
+		archive.numEntries = header.numEntries;
+		archive.names = names;
+		archive.file = file.file;
+		archive.mapping = file.mapping;
+		return 0;
+	}
+
+	void close_archive(MappedArchive& archive)
+	{
+		MappedFile file = { archive.data, archive.size, archive.file, archive.mapping };
+		unmap_file(file);
+		archive = MappedArchive();
+	}
+
+	int32_t archive_model(const MappedArchive& archive, uint32_t entry, ModelData& model)
+	{
+		model = ModelData();
+		if (entry >= archive.numEntries)
+			return -1;
+
+		const TFArchiveEntry& e = archive.entries[entry];
+		return validate_model(reinterpret_cast<const uint8_t*>(archive.data) + e.offset, e.size, model);
+	}
+
+	int32_t read_archive_index(const char* filename, ArchiveIndex& index)
+	{
+		index.entries.clear();
+		index.names.clear();
+
+		NativeFile file = open_file(filename, false);
+		if (invalidFile == file)
+			return -1;
+
+		TFArchive header;
+		bool ok = read_index(file, header, index);
+		close_file(file);
+		return ok ? 0 : -1;
+	}
+
+	int32_t read_archive_entry(const char* filename, const TFArchiveEntry& entry, void* buffer)
+	{
+		NativeFile file = open_file(filename, false);
+		if (invalidFile == file)
+			return -1;
+
+		bool ok = read_at(file, entry.offset, buffer, entry.size);
+		close_file(file);
+		return ok ? 0 : -1;
+	}
+
+	int32_t find_entry(const TFArchiveEntry* entries, uint32_t numEntries, const char* names, StringView name)
+	{
+		uint64_t hash = hash_name(name);
+		const TFArchiveEntry* first = std::lower_bound(entries, entries + numEntries, hash,
+			[](const TFArchiveEntry& e, uint64_t h) { return e.hash < h; });
+
+		for (const TFArchiveEntry* e = first; e != entries + numEntries && e->hash == hash; e++)
+		{
+			if (StringView(names + e->name) == name)
+				return int32_t(e - entries);
+		}
+		return -1;
+	}
+}
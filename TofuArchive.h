@@ -0,0 +1,94 @@
+#pragma once
+
+#include "TofuModel.h"
+
+#include <vector>
+
+namespace tofu
+{
+	// 'TFAR' read as a little endian uint32_t
+	const uint32_t TFArchiveMagic = 0x52414654u;
+	const uint32_t TFArchiveVersion = 1;
+
+	// every entry starts on a page, so a model can be mapped or read alone
+	const uint32_t TFArchiveAlignment = 4096;
+
+	// an archive packs whole TFModel files. The header is followed by the
+	// entries, the table of contents comes last. Appending writes new
+	// entries and a new table of contents after the old one, then rewrites
+	// the header, so existing entries never move and a failed append leaves
+	// the previous contents intact
+	struct TFArchive
+	{
+		uint32_t	magic;
+		uint32_t	version;
+		uint64_t	tocStart;		// TFArchiveEntry[numEntries], then the names
+		uint32_t	numEntries;
+		uint32_t	namesSize;		// bytes, names are null terminated
+		uint64_t	fileSize;		// bytes in use, up to the end of the names
+		uint32_t	tocCrc;			// CRC32C of the entries and names
+		uint32_t	headerCrc;		// CRC32C of the header with this field zero
+	};
+
+	// table of contents entry, sorted by hash and then by name
+	struct TFArchiveEntry
+	{
+		uint64_t	hash;			// hash_name of the name
+		uint64_t	offset;			// of the TFModel file from the start of the archive
+		uint32_t	size;
+		uint32_t	name;			// byte offset into the names
+	};
+
+	// a TFModel file to add under name, an entry with the same name is replaced
+	struct ArchiveItem
+	{
+		const char*	name;
+		const void*	data;			// aligned to TFModelAlignment
+		uint32_t	size;
+	};
+
+	// appends items to filename, creating it if needed. Every item is
+	// validated first and nothing is written if one fails. One writer at a
+	// time, readers that mapped the archive before keep their view, and
+	// open_archive and the read functions share write access on Windows so
+	// the append is not refused while they have it open. Returns 0 on success
+	int32_t append_archive(const char* filename, const ArchiveItem* items, uint32_t count);
+
+	// an archive mapped read only, entries and names point into the mapping
+	struct MappedArchive
+	{
+		const void*				data;
+		size_t					size;
+		const TFArchiveEntry*	entries;
+		uint32_t				numEntries;
+		const char*				names;
+		void*					file;		// HANDLE on Windows, unused elsewhere
+		void*					mapping;	// HANDLE on Windows, unused elsewhere
+	};
+
+	// maps filename and checks its header and table of contents
+	int32_t open_archive(const char* filename, MappedArchive& archive);
+
+	// safe to call on a closed or failed MappedArchive
+	void close_archive(MappedArchive& archive);
+
+	// validates an entry of a mapped archive and points model into it
+	int32_t archive_model(const MappedArchive& archive, uint32_t entry, ModelData& model);
+
+	// the table of contents read with two positioned reads, for readers that
+	// load entries with read_archive_entry instead of mapping the archive
+	struct ArchiveIndex
+	{
+		std::vector<TFArchiveEntry>	entries;
+		std::vector<char>			names;
+	};
+
+	int32_t read_archive_index(const char* filename, ArchiveIndex& index);
+
+	// reads an entry with one positioned read into buffer, which must hold
+	// entry.size bytes and be aligned to TFModelAlignment for validate_model
+	int32_t read_archive_entry(const char* filename, const TFArchiveEntry& entry, void* buffer);
+
+	// the entry called name, or -1
+	int32_t find_entry(const TFArchiveEntry* entries, uint32_t numEntries, const char* names, StringView name);
+}
@@ -0,0 +1,286 @@
+#include "TofuCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+namespace
+{
+	using namespace tofu;
+
+	// temporary files older than this belong to a writer that died
+	const int64_t staleSeconds = 3600;
+
+	struct Entry
+	{
+		char		name[64];
+		uint64_t	size;
+		int64_t		time;
+		bool		temporary;
+	};
+
+	// <16 hex digits>.tfm, or the same followed by .<writer>.tmp
+	bool parse_entry_name(const char* name, bool& temporary)
+	{
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			char c = name[i];
+			if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+				return false;
+		}
+		if (0 != strncmp(name + 16, ".tfm", 4))
+			return false;
+
+		size_t length = strlen(name);
+		temporary = length > 20;
+		return !temporary || (length < sizeof(Entry::name) && 0 == strcmp(name + length - 4, ".tmp"));
+	}
+
+	void entry_path(const char* dir, const char* name, char* path, size_t size)
+	{
+		snprintf(path, size, "%s/%s", dir, name);
+	}
+
+	void key_path(const char* dir, uint64_t key, char* path, size_t size)
+	{
+		snprintf(path, size, "%s/%016llx.tfm", dir, static_cast<unsigned long long>(key));
+	}
+
+#ifdef _WIN32
+	int64_t to_seconds(const FILETIME& t)
+	{
+		return int64_t((uint64_t(t.dwHighDateTime) << 32) | t.dwLowDateTime) / 10000000;
+	}
+
+	int64_t now_seconds()
+	{
+		FILETIME t;
+		GetSystemTimeAsFileTime(&t);
+		return to_seconds(t);
+	}
+
+	uint32_t process_id()
+	{
+		return uint32_t(GetCurrentProcessId());
+	}
+
+	void make_directory(const char* dir)
+	{
+		CreateDirectoryA(dir, nullptr);
+	}
+
+	void remove_file(const char* path)
+	{
+		DeleteFileA(path);
+	}
+
+	bool replace_file(const char* from, const char* to)
+	{
+		return 0 != MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING);
+	}
+
+	bool file_exists(const char* path)
+	{
+		return INVALID_FILE_ATTRIBUTES != GetFileAttributesA(path);
+	}
+
+	void touch_file(const char* path)
+	{
+		HANDLE file = CreateFileA(path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (INVALID_HANDLE_VALUE == file)
+			return;
+		FILETIME t;
+		GetSystemTimeAsFileTime(&t);
+		SetFileTime(file, nullptr, nullptr, &t);
+		CloseHandle(file);
+	}
+
+	void list_entries(const char* dir, std::vector<Entry>& entries)
+	{
+		char pattern[MAX_PATH];
+		snprintf(pattern, sizeof(pattern), "%s/*", dir);
+
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA(pattern, &data);
+		if (INVALID_HANDLE_VALUE == find)
+			return;
+
+		do
+		{
+			Entry e;
+			if (0 != (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !parse_entry_name(data.cFileName, e.temporary))
+				continue;
+			strcpy(e.name, data.cFileName);
+			e.size = (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+			e.time = to_seconds(data.ftLastWriteTime);
+			entries.push_back(e);
+		} while (FindNextFileA(find, &data));
+
+		FindClose(find);
+	}
+#else
+	int64_t now_seconds()
+	{
+		return int64_t(time(nullptr));
+	}
+
+	uint32_t process_id()
+	{
+		return uint32_t(getpid());
+	}
+
+	void make_directory(const char* dir)
+	{
+		mkdir(dir, 0755);
+	}
+
+	void remove_file(const char* path)
+	{
+		unlink(path);
+	}
+
+	bool replace_file(const char* from, const char* to)
+	{
+		return 0 == rename(from, to);
+	}
+
+	bool file_exists(const char* path)
+	{
+		return 0 == access(path, F_OK);
+	}
+
+	void touch_file(const char* path)
+	{
+		utimes(path, nullptr);
+	}
+
+	void list_entries(const char* dir, std::vector<Entry>& entries)
+	{
+		DIR* d = opendir(dir);
+		if (nullptr == d)
+			return;
+
+		while (dirent* ent = readdir(d))
+		{
+			Entry e;
+			if (!parse_entry_name(ent->d_name, e.temporary))
+				continue;
+
+			char path[4096];
+			struct stat st;
+			entry_path(dir, ent->d_name, path, sizeof(path));
+			if (0 != stat(path, &st) || !S_ISREG(st.st_mode))
+				continue;
+
+			strcpy(e.name, ent->d_name);
+			e.size = uint64_t(st.st_size);
+			e.time = int64_t(st.st_mtime);
+			entries.push_back(e);
+		}
+
+		closedir(d);
+	}
+#endif
+}
+
+namespace tofu
+{
+	uint64_t import_key(const void* source, size_t size, uint32_t flags, uint32_t importerVersion)
+	{
+		uint32_t salt[3] = { flags, importerVersion, TFModelVersion };
+		return hash_bytes(salt, sizeof(salt), hash_bytes(source, size));
+	}
+
+	int32_t cache_lookup(const char* dir, uint64_t key, MappedModel& mapped)
+	{
+		char path[4096];
+		key_path(dir, key, path, sizeof(path));
+
+		if (0 != open_model(path, mapped))
+		{
+			// a file that exists but does not validate is dropped so the next
+			// store replaces it
+			if (file_exists(path))
+				remove_file(path);
+			return -1;
+		}
+
+		touch_file(path);
+		return 0;
+	}
+
+	int32_t cache_store(const char* dir, uint64_t key, const ModelData& model, uint64_t maxBytes)
+	{
+		static uint32_t counter = 0;
+
+		make_directory(dir);
+
+		char path[4096];
+		char temp[4096 + 32];
+		key_path(dir, key, path, sizeof(path));
+		snprintf(temp, sizeof(temp), "%s.%u.%u.tmp", path, process_id(), counter++);
+
+		if (0 != write_model(temp, model))
+		{
+			remove_file(temp);
+			return -1;
+		}
+
+		// two processes storing the same key write the same bytes, so losing
+		// the race to another writer is still a success
+		if (!replace_file(temp, path))
+		{
+			remove_file(temp);
+			if (!file_exists(path))
+				return -1;
+		}
+
+		cache_trim(dir, maxBytes);
+		return 0;
+	}
+
+	void cache_trim(const char* dir, uint64_t maxBytes)
+	{
+		std::vector<Entry> entries;
+		list_entries(dir, entries);
+
+		int64_t now = now_seconds();
+		uint64_t total = 0;
+		for (const Entry& e : entries)
+			total += e.size;
+
+		// oldest first, stale temporaries go regardless of size
+		std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+
+		char path[4096];
+		for (const Entry& e : entries)
+		{
+			if (e.temporary ? now - e.time < staleSeconds : total <= maxBytes)
+				continue;
+
+			// failing to remove an entry another process has open is fine,
+			// the next trim tries again
+			entry_path(dir, e.name, path, sizeof(path));
+			remove_file(path);
+			total -= e.size;
+		}
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "TofuModel.h"
+
+namespace tofu
+{
+	// cache key of an imported file, covers the source bytes, the import
+	// flags, the importer's own version and TFModelVersion
+	uint64_t import_key(const void* source, size_t size, uint32_t flags, uint32_t importerVersion);
+
+	// an import cache is a directory of <key>.tfm files, shared by every
+	// process using it. Entries are renamed into place once complete, so
+	// readers never see a partial file, and the file time records the last
+	// use for LRU eviction.
+
+	// maps the entry for key and marks it used, returns 0 on a hit.
+	// An entry that fails validation is removed
+	int32_t cache_lookup(const char* dir, uint64_t key, MappedModel& mapped);
+
+	// stores model as the entry for key, creating dir if needed, then trims
+	// the cache to maxBytes. Returns 0 on success
+	int32_t cache_store(const char* dir, uint64_t key, const ModelData& model, uint64_t maxBytes);
+
+	// removes least recently used entries until at most maxBytes remain,
+	// along with temporary files left behind by writers that died
+	void cache_trim(const char* dir, uint64_t maxBytes);
+}
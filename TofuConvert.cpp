@@ -0,0 +1,725 @@
+#include "TofuConvert.h"
+
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+namespace
+{
+	using namespace tofu;
+	using namespace tofu::math;
+
+	// Assimp splits FBX nodes with pivots into chains named
+	// <node>_$AssimpFbx$_<part>, the bone is named after the node
+	const char* fbxSuffix = "_$AssimpFbx$_";
+
+	StringView bone_name(const aiString& name)
+	{
+		const char* suffix = strstr(name.C_Str(), fbxSuffix);
+		return StringView(name.C_Str(), nullptr != suffix ? size_t(suffix - name.C_Str()) : name.length);
+	}
+
+	// what welding compares, the bytes of the vertex or, with an epsilon,
+	// every float rounded to a multiple of it
+	struct WeldKey
+	{
+		int32_t		v[sizeof(SkinnedVertex) / sizeof(int32_t)];
+	};
+
+	static_assert(sizeof(SkinnedVertex) == 80, "WeldKey expects 16 floats and int4 bones");
+
+	WeldKey weld_key(const SkinnedVertex& vertex, float epsilon)
+	{
+		WeldKey key;
+		memcpy(&key, &vertex, sizeof(key));
+		if (epsilon <= 0.0f)
+			return key;
+
+		const float* f = reinterpret_cast<const float*>(&vertex);
+		for (uint32_t i = 0; i < 20; i++)
+		{
+			if (i >= 12 && i < 16)
+				continue;	// bone indices
+			// NaN passes the clamp and converting it is undefined, those
+			// keep their bits, as CalcTangentSpace writes for points and lines
+			double q = std::floor(double(f[i]) / epsilon + 0.5);
+			if (q != q)
+				continue;
+			key.v[i] = int32_t(std::max(std::min(q, 2147483647.0), -2147483648.0));
+		}
+		return key;
+	}
+
+	// keeps the first of every group of equal vertices, in order, and
+	// remaps the indices of mesh. kept receives the mesh relative indices
+	// of the vertices that stay
+	void weld_mesh(const SkinnedVertex* vertices, uint32_t* indices, const Mesh& mesh, float epsilon,
+		std::vector<uint32_t>& kept)
+	{
+		kept.clear();
+		if (0 == mesh.numVertices)
+			return;
+
+		std::vector<WeldKey> keys(mesh.numVertices);
+		for (uint32_t i = 0; i < mesh.numVertices; i++)
+			keys[i] = weld_key(vertices[mesh.startVertex + i], epsilon);
+
+		// open addressing with linear probing over kept, at most half full
+		uint32_t tableSize = 2;
+		while (tableSize < mesh.numVertices * 2)
+			tableSize *= 2;
+		std::vector<uint32_t> table(tableSize, ~0u);
+		std::vector<uint32_t> remap(mesh.numVertices);
+
+		for (uint32_t i = 0; i < mesh.numVertices; i++)
+		{
+			uint32_t slot = uint32_t(hash_bytes(&keys[i], sizeof(WeldKey))) & (tableSize - 1);
+			while (~0u != table[slot] && 0 != memcmp(&keys[kept[table[slot]]], &keys[i], sizeof(WeldKey)))
+				slot = (slot + 1) & (tableSize - 1);
+
+			if (~0u == table[slot])
+			{
+				table[slot] = uint32_t(kept.size());
+				kept.push_back(i);
+			}
+			remap[i] = table[slot];
+		}
+
+		for (uint32_t i = 0; i < mesh.numIndices; i++)
+		{
+			uint32_t& index = indices[mesh.startIndex + i];
+			if (index < mesh.numVertices)
+				index = remap[index];
+		}
+	}
+
+	// misses of a FIFO cache, a vertex is in it while fewer than cacheSize
+	// misses have happened since its own
+	uint64_t cache_misses(const uint32_t* indices, uint32_t numIndices, uint32_t numVertices, uint32_t cacheSize,
+		std::vector<uint32_t>& stamps)
+	{
+		stamps.assign(numVertices, 0);
+		uint32_t time = cacheSize + 1;
+		for (uint32_t i = 0; i < numIndices; i++)
+		{
+			uint32_t v = indices[i];
+			if (v < numVertices && time - stamps[v] > cacheSize)
+				stamps[v] = time++;
+		}
+		return time - cacheSize - 1;
+	}
+
+	// Tipsify (Sander, Nehab and Barczak 2007), linear in the triangles.
+	// Emits every triangle around a fanning vertex, then fans around the
+	// candidate that stays longest in the cache while its remaining
+	// triangles still fit, else a recent vertex with triangles left, else
+	// the next such vertex in index order
+	void tipsify(const uint32_t* indices, uint32_t numTriangles, uint32_t numVertices, uint32_t cacheSize, uint32_t* out)
+	{
+		// triangles of every vertex, offsets are a prefix sum of the counts
+		std::vector<uint32_t> live(numVertices, 0);
+		for (uint32_t i = 0; i < numTriangles * 3; i++)
+			live[indices[i]]++;
+
+		std::vector<uint32_t> offsets(numVertices + 1, 0);
+		for (uint32_t v = 0; v < numVertices; v++)
+			offsets[v + 1] = offsets[v] + live[v];
+
+		std::vector<uint32_t> adjacency(numTriangles * 3);
+		{
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (uint32_t i = 0; i < numTriangles * 3; i++)
+				adjacency[fill[indices[i]]++] = i / 3;
+		}
+
+		std::vector<uint32_t> stamps(numVertices, 0);
+		std::vector<uint8_t> emitted(numTriangles, 0);
+		std::vector<uint32_t> deadEnds;
+		std::vector<uint32_t> candidates;
+		uint32_t time = cacheSize + 1;
+		uint32_t cursor = 0;
+		uint32_t written = 0;
+
+		uint32_t fan = numVertices > 0 ? 0 : ~0u;
+		while (~0u != fan)
+		{
+			candidates.clear();
+			for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; a++)
+			{
+				uint32_t t = adjacency[a];
+				if (emitted[t])
+					continue;
+				emitted[t] = 1;
+
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					uint32_t v = indices[t * 3 + k];
+					out[written++] = v;
+					deadEnds.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - stamps[v] > cacheSize)
+						stamps[v] = time++;
+				}
+			}
+
+			fan = ~0u;
+			int64_t best = -1;
+			for (uint32_t v : candidates)
+			{
+				if (0 == live[v])
+					continue;
+				int64_t priority = 0;
+				if (time - stamps[v] + 2 * live[v] <= cacheSize)
+					priority = time - stamps[v];
+				if (priority > best)
+				{
+					best = priority;
+					fan = v;
+				}
+			}
+
+			while (~0u == fan && !deadEnds.empty())
+			{
+				uint32_t v = deadEnds.back();
+				deadEnds.pop_back();
+				if (live[v] > 0)
+					fan = v;
+			}
+
+			for (; ~0u == fan && cursor < numVertices; cursor++)
+			{
+				if (live[cursor] > 0)
+					fan = cursor;
+			}
+		}
+	}
+
+	// triangles in cache order, then vertices in the order the new
+	// indices first use them, unused ones last. A trailing partial
+	// triangle stays where it is
+	void optimize_mesh(SkinnedVertex* vertices, uint32_t* indices, const Mesh& mesh, uint32_t cacheSize)
+	{
+		uint32_t* meshIndices = indices + mesh.startIndex;
+		for (uint32_t i = 0; i < mesh.numIndices; i++)
+		{
+			if (meshIndices[i] >= mesh.numVertices)
+				return;
+		}
+
+		uint32_t numTriangles = mesh.numIndices / 3;
+		std::vector<uint32_t> ordered(numTriangles * 3);
+		tipsify(meshIndices, numTriangles, mesh.numVertices, cacheSize, ordered.data());
+		std::copy(ordered.begin(), ordered.end(), meshIndices);
+
+		std::vector<uint32_t> remap(mesh.numVertices, ~0u);
+		uint32_t next = 0;
+		for (uint32_t i = 0; i < mesh.numIndices; i++)
+		{
+			if (~0u == remap[meshIndices[i]])
+				remap[meshIndices[i]] = next++;
+			meshIndices[i] = remap[meshIndices[i]];
+		}
+
+		std::vector<SkinnedVertex> old(vertices + mesh.startVertex, vertices + mesh.startVertex + mesh.numVertices);
+		for (uint32_t v = 0; v < mesh.numVertices; v++)
+		{
+			if (~0u == remap[v])
+				remap[v] = next++;
+			vertices[mesh.startVertex + remap[v]] = old[v];
+		}
+	}
+
+	void set_mesh_matrices(const aiNode* node, float4x4 parentTransform, std::vector<Mesh>& meshes, uint32_t firstMesh)
+	{
+		float4x4 local;
+		memcpy(&local, &node->mTransformation, sizeof(local));
+		float4x4 current = parentTransform * local;
+		float3x4 matrix = toFloat3x4(current);
+
+		// a mesh used by several nodes keeps the transform of the last one
+		for (uint32_t i = 0; i < node->mNumMeshes; i++)
+		{
+			Mesh& m = meshes[firstMesh + node->mMeshes[i]];
+			memcpy(m.matrix, &matrix, sizeof(m.matrix));
+		}
+
+		for (uint32_t i = 0; i < node->mNumChildren; i++)
+		{
+			set_mesh_matrices(node->mChildren[i], current, meshes, firstMesh);
+		}
+	}
+
+	// runs task(0) to task(count - 1) on up to numThreads threads, the
+	// calling one included, each taking the next index when it is done
+	void run_tasks(uint32_t count, uint32_t numThreads, const std::function<void(uint32_t)>& task)
+	{
+		std::atomic<uint32_t> next(0);
+		auto work = [&]
+		{
+			for (uint32_t i = next++; i < count; i = next++)
+				task(i);
+		};
+
+		std::vector<std::thread> threads;
+		for (uint32_t i = 1; i < std::min(numThreads, count); i++)
+			threads.push_back(std::thread(work));
+		work();
+		for (std::thread& t : threads)
+			t.join();
+	}
+
+	// part of the vertices or faces of one mesh, so a large mesh is spread
+	// over the threads instead of finishing alone at the end
+	struct MeshSlice
+	{
+		uint32_t	mesh;
+		uint32_t	begin;
+		uint32_t	end;
+		bool		faces;
+		aabb		bounds;		// of the vertices
+	};
+
+	const uint32_t sliceSize = 1 << 15;
+
+	// sizes the arrays and places every mesh with a prefix sum over the
+	// mesh sizes, the slices then fill them in any order
+	void plan_meshes(const aiScene* scene, std::vector<SkinnedVertex>& vertices,
+		std::vector<uint32_t>& indices, std::vector<Mesh>& meshes, std::vector<MeshSlice>& slices)
+	{
+		uint32_t vid = uint32_t(vertices.size());
+		uint32_t iid = uint32_t(indices.size());
+		uint32_t firstMesh = uint32_t(meshes.size());
+
+		meshes.resize(firstMesh + scene->mNumMeshes);
+		for (uint32_t i = 0; i < scene->mNumMeshes; i++)
+		{
+			const aiMesh* m = scene->mMeshes[i];
+
+			Mesh& mesh = meshes[firstMesh + i];
+			mesh = Mesh();
+			float3x4 meshMatrix = identity3x4();
+			memcpy(mesh.matrix, &meshMatrix, sizeof(mesh.matrix));
+			mesh.startVertex = vid;
+			mesh.startIndex = iid;
+			mesh.numVertices = m->mNumVertices;
+			mesh.numIndices = m->mNumFaces * 3;
+
+			for (uint32_t j = 0; j < m->mNumVertices; j += sliceSize)
+				slices.push_back(MeshSlice{ firstMesh + i, j, std::min(j + sliceSize, m->mNumVertices), false, aabb() });
+			for (uint32_t j = 0; j < m->mNumFaces; j += sliceSize)
+				slices.push_back(MeshSlice{ firstMesh + i, j, std::min(j + sliceSize, m->mNumFaces), true, aabb() });
+
+			vid += m->mNumVertices;
+			iid += m->mNumFaces * 3;
+		}
+
+		vertices.resize(vid);
+		indices.resize(iid);
+	}
+
+	void pack_slice(const aiScene* scene, uint32_t firstMesh, MeshSlice& slice,
+		SkinnedVertex* vertices, uint32_t* indices, const Mesh* meshes)
+	{
+		const aiMesh* m = scene->mMeshes[slice.mesh - firstMesh];
+		const Mesh& mesh = meshes[slice.mesh];
+
+		if (slice.faces)
+		{
+			// faces are triangles after aiProcess_Triangulate, points and
+			// lines are dropped as degenerate triangles
+			for (uint32_t j = slice.begin; j < slice.end; j++)
+			{
+				const aiFace& f = m->mFaces[j];
+				for (uint32_t k = 0; k < 3; k++)
+					indices[mesh.startIndex + j * 3 + k] = f.mIndices[f.mNumIndices == 3 ? k : 0];
+			}
+			return;
+		}
+
+		// tangents need texture coordinates, both may be missing
+		const aiVector3D zero(0.0f, 0.0f, 0.0f);
+		for (uint32_t j = slice.begin; j < slice.end; j++)
+		{
+			auto& pos = m->mVertices[j];
+			auto& norm = nullptr != m->mNormals ? m->mNormals[j] : zero;
+			auto& tan = nullptr != m->mTangents ? m->mTangents[j] : zero;
+			auto& uv = nullptr != m->mTextureCoords[0] ? m->mTextureCoords[0][j] : zero;
+
+			SkinnedVertex& v = vertices[mesh.startVertex + j];
+			v = SkinnedVertex();
+			v.position = float3{ pos.x, pos.y, pos.z };
+			v.normal = float3{ norm.x, norm.y, norm.z };
+			v.tangent = float3{ tan.x, tan.y, tan.z };
+			v.uv = float3{ uv.x, uv.y, uv.z };
+		}
+		slice.bounds = aabbFromPoints(reinterpret_cast<const float3*>(m->mVertices + slice.begin), slice.end - slice.begin);
+	}
+
+	// merges the bounds of the slices, which are in mesh order
+	void finish_meshes(const aiScene* scene, uint32_t firstMesh, const std::vector<MeshSlice>& slices, std::vector<Mesh>& meshes)
+	{
+		for (const MeshSlice& slice : slices)
+		{
+			if (slice.faces)
+				continue;
+
+			aabb& b = meshes[slice.mesh].bounds;
+			if (0 == slice.begin)
+			{
+				b = slice.bounds;
+				continue;
+			}
+			b.min.x = std::min(b.min.x, slice.bounds.min.x);
+			b.min.y = std::min(b.min.y, slice.bounds.min.y);
+			b.min.z = std::min(b.min.z, slice.bounds.min.z);
+			b.max.x = std::max(b.max.x, slice.bounds.max.x);
+			b.max.y = std::max(b.max.y, slice.bounds.max.y);
+			b.max.z = std::max(b.max.z, slice.bounds.max.z);
+		}
+
+		if (nullptr != scene->mRootNode)
+			set_mesh_matrices(scene->mRootNode, identity(), meshes, firstMesh);
+	}
+
+	int32_t convert_skeleton_node(const aiNode* node, int32_t parentBoneIdx, std::vector<Bone>& bones, std::vector<char>& strings)
+	{
+		StringView nodeName = bone_name(node->mName);
+		aiMatrix4x4 matrix = node->mTransformation;
+
+		if (nodeName.size != node->mName.length)
+		{
+			while (node->mNumChildren == 1)
+			{
+				const aiNode* n = node->mChildren[0];
+				if (bone_name(n->mName) == nodeName)
+				{
+					matrix = matrix * n->mTransformation;
+					node = n;
+					continue;
+				}
+				break;
+			}
+		}
+
+		int32_t boneId = int32_t(bones.size());
+		bones.push_back(Bone());
+		Bone& bone = bones[boneId];
+		bone.parent = parentBoneIdx;
+		bone.firstChild = -1;
+		bone.nextSibling = -1;
+
+		bone.name = int32_t(strings.size());
+		strings.insert(strings.end(), nodeName.data, nodeName.data + nodeName.size);
+		strings.push_back(0);
+
+		for (uint32_t i = 0; i < 3; i++)
+			for (uint32_t j = 0; j < 4; j++)
+				bone.matrix[i * 4 + j] = matrix[i][j];
+
+		int32_t lastChild = -1;
+		for (uint32_t i = 0; i < node->mNumChildren; ++i)
+		{
+			int32_t bId = convert_skeleton_node(node->mChildren[i], boneId, bones, strings);
+
+			Bone& bone = bones[boneId];
+			if (bone.firstChild == -1)
+				bone.firstChild = bId;
+			else
+				bones[lastChild].nextSibling = bId;
+
+			lastChild = bId;
+		}
+
+		return boneId;
+	}
+}
+
+namespace tofu
+{
+	const uint32_t importFlags =
+		aiProcess_Triangulate |
+		aiProcess_GenNormals |
+		aiProcess_CalcTangentSpace |
+		aiProcess_ConvertToLeftHanded;
+
+	int32_t convert_meshes(const aiScene* scene, std::vector<SkinnedVertex>& vertices,
+		std::vector<uint32_t>& indices, std::vector<Mesh>& meshes, uint32_t numThreads)
+	{
+		if (nullptr == scene) return -1;
+
+		uint32_t firstMesh = uint32_t(meshes.size());
+		std::vector<MeshSlice> slices;
+		plan_meshes(scene, vertices, indices, meshes, slices);
+
+		run_tasks(uint32_t(slices.size()), numThreads, [&](uint32_t i)
+		{
+			pack_slice(scene, firstMesh, slices[i], vertices.data(), indices.data(), meshes.data());
+		});
+
+		finish_meshes(scene, firstMesh, slices, meshes);
+		return 0;
+	}
+
+	uint32_t weld_meshes(std::vector<SkinnedVertex>& vertices, std::vector<uint32_t>& indices,
+		std::vector<Mesh>& meshes, float epsilon, uint32_t numThreads)
+	{
+		std::vector<std::vector<uint32_t>> kept(meshes.size());
+		run_tasks(uint32_t(meshes.size()), numThreads, [&](uint32_t i)
+		{
+			weld_mesh(vertices.data(), indices.data(), meshes[i], epsilon, kept[i]);
+		});
+
+		// the meshes move down over the removed vertices, a prefix sum of
+		// what each keeps, and copy their vertices in parallel again
+		std::vector<uint32_t> starts(meshes.size());
+		uint32_t numVertices = 0;
+		for (uint32_t i = 0; i < meshes.size(); i++)
+		{
+			starts[i] = numVertices;
+			numVertices += uint32_t(kept[i].size());
+		}
+
+		std::vector<SkinnedVertex> welded(numVertices);
+		run_tasks(uint32_t(meshes.size()), numThreads, [&](uint32_t i)
+		{
+			for (uint32_t j = 0; j < kept[i].size(); j++)
+				welded[starts[i] + j] = vertices[meshes[i].startVertex + kept[i][j]];
+		});
+
+		for (uint32_t i = 0; i < meshes.size(); i++)
+		{
+			meshes[i].startVertex = starts[i];
+			meshes[i].numVertices = uint32_t(kept[i].size());
+		}
+
+		uint32_t removed = uint32_t(vertices.size()) - numVertices;
+		vertices.swap(welded);
+		return removed;
+	}
+
+	VertexCacheStats vertex_cache_stats(const std::vector<uint32_t>& indices, const std::vector<Mesh>& meshes, uint32_t cacheSize)
+	{
+		VertexCacheStats stats = {};
+		std::vector<uint32_t> stamps;
+		for (const Mesh& m : meshes)
+		{
+			stats.triangles += m.numIndices / 3;
+			stats.vertices += m.numVertices;
+			stats.misses += cache_misses(indices.data() + m.startIndex, m.numIndices, m.numVertices, cacheSize, stamps);
+		}
+		return stats;
+	}
+
+	void optimize_meshes(std::vector<SkinnedVertex>& vertices, std::vector<uint32_t>& indices,
+		const std::vector<Mesh>& meshes, uint32_t cacheSize, uint32_t numThreads)
+	{
+		run_tasks(uint32_t(meshes.size()), numThreads, [&](uint32_t i)
+		{
+			optimize_mesh(vertices.data(), indices.data(), meshes[i], cacheSize);
+		});
+	}
+
+	int32_t convert_skeleton(const aiNode* node, std::vector<Bone>& bones,
+		std::vector<char>& strings, std::vector<TFNameSlot>& names)
+	{
+		bones.clear();
+		strings.clear();
+		names.clear();
+
+		if (nullptr == node) return -1;
+
+		const aiNode* root = node;
+		for (const aiNode* p = node->mParent; nullptr != p; p = p->mParent)
+		{
+			if (nullptr == strstr(p->mName.C_Str(), fbxSuffix))
+				break;
+			root = p;
+		}
+
+		convert_skeleton_node(root, -1, bones, strings);
+
+		names.resize(name_table_size(uint32_t(bones.size())));
+		if (0 != build_name_table(bones.data(), uint32_t(bones.size()), strings.data(),
+			names.data(), uint32_t(names.size())))
+		{
+			names.clear();
+			return -1;
+		}
+
+		return 0;
+	}
+
+	int32_t convert_animation(const aiAnimation* a, uint32_t numBones, const std::vector<TFNameSlot>& names,
+		Animation& outAnim, std::vector<Track>& outTracks,
+		std::vector<VectorFrame>& outVectorFrames, std::vector<QuaternionFrame>& outQuatFrames)
+	{
+		if (nullptr == a) return -1;
+
+		outAnim.frameRate = a->mTicksPerSecond == 0.0 ? 1.0f : float(a->mTicksPerSecond);
+		outAnim.duration = float(a->mDuration);
+		outAnim.tracks = uint32_t(outTracks.size());
+		outAnim.numTracks = numBones;
+
+		outTracks.resize(outTracks.size() + numBones);
+
+		for (uint32_t i = 0; i < a->mNumChannels; ++i)
+		{
+			auto& ch = a->mChannels[i];
+			int32_t boneId = find_name(names.data(), uint32_t(names.size()), hash_name(bone_name(ch->mNodeName)));
+			if (boneId == -1)
+				continue;
+
+			Track& t = outTracks[outAnim.tracks + boneId];
+
+			t.numTransFrames = ch->mNumPositionKeys;
+			t.transFrames = uint32_t(outVectorFrames.size());
+			for (uint32_t f = 0; f < t.numTransFrames; f++)
+			{
+				auto& k = ch->mPositionKeys[f];
+
+				outVectorFrames.push_back(VectorFrame{
+					float3{ k.mValue.x, k.mValue.y, k.mValue.z},
+					float(k.mTime)
+				});
+			}
+
+			t.numRotFrames = ch->mNumRotationKeys;
+			t.rotFrames = uint32_t(outQuatFrames.size());
+			for (uint32_t f = 0; f < t.numRotFrames; f++)
+			{
+				auto& k = ch->mRotationKeys[f];
+
+				outQuatFrames.push_back(QuaternionFrame{
+					float4{ k.mValue.x, k.mValue.y, k.mValue.z, k.mValue.w },
+					float(k.mTime)
+				});
+			}
+
+			t.numScaleFrames = ch->mNumScalingKeys;
+			t.scaleFrames = uint32_t(outVectorFrames.size());
+			for (uint32_t f = 0; f < t.numScaleFrames; f++)
+			{
+				auto& k = ch->mScalingKeys[f];
+
+				outVectorFrames.push_back(VectorFrame{
+					float3{ k.mValue.x, k.mValue.y, k.mValue.z },
+					float(k.mTime)
+				});
+			}
+		}
+
+		return 0;
+	}
+
+	int32_t convert_scene(const aiScene* scene, ConvertedModel& model, uint32_t numThreads)
+	{
+		model = ConvertedModel();
+
+		if (nullptr == scene) return -1;
+
+		// the skeleton goes first, it is one task and the animations wait
+		// for it, the mesh slices fill the other threads meanwhile
+		std::vector<MeshSlice> slices;
+		plan_meshes(scene, model.vertices, model.indices, model.meshes, slices);
+
+		bool animated = scene->mNumAnimations > 0;
+		int32_t skeleton = 0;
+		run_tasks(uint32_t(slices.size()) + 1, numThreads, [&](uint32_t i)
+		{
+			if (0 == i)
+			{
+				if (animated)
+					skeleton = convert_skeleton(scene->mRootNode, model.bones, model.strings, model.names);
+				return;
+			}
+			pack_slice(scene, 0, slices[i - 1], model.vertices.data(), model.indices.data(), model.meshes.data());
+		});
+
+		finish_meshes(scene, 0, slices, model.meshes);
+
+		if (!animated)
+			return 0;
+
+		if (0 != skeleton)
+			return -1;
+
+		// every animation into arrays of its own, then appended in order
+		// with the frame and track indices moved by what came before
+		struct ConvertedAnimation
+		{
+			int32_t							ret;
+			Animation						anim;
+			std::vector<Track>				tracks;
+			std::vector<VectorFrame>		vectorFrames;
+			std::vector<QuaternionFrame>	quatFrames;
+		};
+
+		std::vector<ConvertedAnimation> anims(scene->mNumAnimations);
+		run_tasks(scene->mNumAnimations, numThreads, [&](uint32_t i)
+		{
+			ConvertedAnimation& a = anims[i];
+			a.anim = Animation();
+			a.ret = convert_animation(scene->mAnimations[i], uint32_t(model.bones.size()), model.names,
+				a.anim, a.tracks, a.vectorFrames, a.quatFrames);
+		});
+
+		for (ConvertedAnimation& a : anims)
+		{
+			if (0 != a.ret)
+				return -1;
+
+			// tracks of bones without a channel stay all zero
+			uint32_t vectorBase = uint32_t(model.vectorFrames.size());
+			uint32_t quatBase = uint32_t(model.quatFrames.size());
+			for (Track& t : a.tracks)
+			{
+				if (0 == t.numTransFrames + t.numRotFrames + t.numScaleFrames)
+					continue;
+				t.transFrames += vectorBase;
+				t.rotFrames += quatBase;
+				t.scaleFrames += vectorBase;
+			}
+
+			a.anim.tracks = uint32_t(model.tracks.size());
+			model.anims.push_back(a.anim);
+			model.tracks.insert(model.tracks.end(), a.tracks.begin(), a.tracks.end());
+			model.vectorFrames.insert(model.vectorFrames.end(), a.vectorFrames.begin(), a.vectorFrames.end());
+			model.quatFrames.insert(model.quatFrames.end(), a.quatFrames.begin(), a.quatFrames.end());
+		}
+
+		return 0;
+	}
+
+	ModelData model_data(const ConvertedModel& model)
+	{
+		ModelData data = {};
+		data.vertices = model.vertices.data();
+		data.numVertices = uint32_t(model.vertices.size());
+		data.indices = model.indices.data();
+		data.numIndices = uint32_t(model.indices.size());
+		data.meshes = model.meshes.data();
+		data.numMeshes = uint32_t(model.meshes.size());
+		data.bones = model.bones.data();
+		data.numBones = uint32_t(model.bones.size());
+		data.anims = model.anims.data();
+		data.numAnims = uint32_t(model.anims.size());
+		data.tracks = model.tracks.data();
+		data.numTracks = uint32_t(model.tracks.size());
+		data.vectorFrames = model.vectorFrames.data();
+		data.numVectorFrames = uint32_t(model.vectorFrames.size());
+		data.quatFrames = model.quatFrames.data();
+		data.numQuatFrames = uint32_t(model.quatFrames.size());
+		data.strings = model.strings.data();
+		data.stringSize = uint32_t(model.strings.size());
+		data.names = model.names.data();
+		data.numNameSlots = uint32_t(model.names.size());
+		return data;
+	}
+}
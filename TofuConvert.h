@@ -0,0 +1,95 @@
+#pragma once
+
+#include "TofuModel.h"
+
+#include <vector>
+
+struct aiScene;
+struct aiNode;
+struct aiAnimation;
+
+namespace tofu
+{
+	// Assimp post processing every conversion runs with
+	extern const uint32_t importFlags;
+
+	// bump when the conversion below changes, so import cache entries and
+	// converted files made by older code stop matching
+	const uint32_t importerVersion = 4;
+
+	// vertices of the post transform cache optimize_meshes plans for
+	const uint32_t vertexCacheSize = 16;
+
+	// the arrays a converted scene is made of, see model_data
+	struct ConvertedModel
+	{
+		std::vector<SkinnedVertex>		vertices;
+		std::vector<uint32_t>			indices;
+		std::vector<Mesh>				meshes;
+		std::vector<Bone>				bones;
+		std::vector<char>				strings;
+		std::vector<TFNameSlot>			names;
+		std::vector<Animation>			anims;
+		std::vector<Track>				tracks;
+		std::vector<VectorFrame>		vectorFrames;
+		std::vector<QuaternionFrame>	quatFrames;
+	};
+
+	// appends the meshes of scene, with their bounds and the transform of
+	// the last node using each. Meshes are placed up front and packed in
+	// slices on numThreads threads
+	int32_t convert_meshes(const aiScene* scene, std::vector<SkinnedVertex>& vertices,
+		std::vector<uint32_t>& indices, std::vector<Mesh>& meshes, uint32_t numThreads = 1);
+
+	// merges the vertices of each mesh that are bit identical or, with an
+	// epsilon above 0, whose attributes round to the same multiple of it,
+	// and remaps the indices of the mesh. Near equal vertices that round to
+	// neighbouring multiples stay apart. Meshes are welded in parallel and
+	// then packed in order, vertices outside every mesh are dropped.
+	// Returns the number of vertices removed
+	uint32_t weld_meshes(std::vector<SkinnedVertex>& vertices, std::vector<uint32_t>& indices,
+		std::vector<Mesh>& meshes, float epsilon = 0.0f, uint32_t numThreads = 1);
+
+	// how the indices of meshes use a FIFO post transform cache. ACMR is
+	// misses per triangle, 0.5 at best on large meshes and 3 at worst,
+	// ATVR misses per vertex, 1 at best
+	struct VertexCacheStats
+	{
+		uint64_t	triangles;
+		uint64_t	vertices;
+		uint64_t	misses;
+
+		float acmr() const { return triangles > 0 ? float(double(misses) / triangles) : 0.0f; }
+		float atvr() const { return vertices > 0 ? float(double(misses) / vertices) : 0.0f; }
+	};
+
+	VertexCacheStats vertex_cache_stats(const std::vector<uint32_t>& indices, const std::vector<Mesh>& meshes,
+		uint32_t cacheSize = vertexCacheSize);
+
+	// reorders the triangles of every mesh for the post transform cache
+	// with Tipsify, then its vertices in the order the triangles first use
+	// them for vertex fetch. Meshes keep their ranges and are done in
+	// parallel, those with indices out of range are left alone
+	void optimize_meshes(std::vector<SkinnedVertex>& vertices, std::vector<uint32_t>& indices,
+		const std::vector<Mesh>& meshes, uint32_t cacheSize = vertexCacheSize, uint32_t numThreads = 1);
+
+	// replaces bones, strings and names with the skeleton rooted at node.
+	// Chains of FBX pivot nodes fold into one bone, including those above node
+	int32_t convert_skeleton(const aiNode* node, std::vector<Bone>& bones,
+		std::vector<char>& strings, std::vector<TFNameSlot>& names);
+
+	// appends the tracks and frames of a to the given arrays, one track per
+	// bone, channels are bound to bones through names
+	int32_t convert_animation(const aiAnimation* a, uint32_t numBones, const std::vector<TFNameSlot>& names,
+		Animation& outAnim, std::vector<Track>& outTracks,
+		std::vector<VectorFrame>& outVectorFrames, std::vector<QuaternionFrame>& outQuatFrames);
+
+	// the meshes of scene and, when it is animated, a skeleton from the
+	// root node with every animation. The skeleton is built alongside the
+	// meshes and the animations then convert in parallel, on numThreads
+	// threads in all
+	int32_t convert_scene(const aiScene* scene, ConvertedModel& model, uint32_t numThreads = 1);
+
+	// points a ModelData at the arrays of model
+	ModelData model_data(const ConvertedModel& model);
+}
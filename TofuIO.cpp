@@ -0,0 +1,507 @@
+#include "TofuIO.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// io_uring is used through its system calls, so no liburing is needed,
+// only kernel headers that know it. TOFU_NO_IO_URING forces the threads
+#if defined(__linux__) && !defined(TOFU_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define TOFU_IO_URING
+#endif
+#endif
+#endif
+
+namespace
+{
+	using namespace tofu;
+
+	struct Completion
+	{
+		ReadRequest	request;
+		int64_t		result;
+	};
+
+	// a blocking positioned read, repeated until size bytes or the end of the file
+	int64_t read_at(const IOFile& file, uint64_t offset, void* buffer, uint32_t size)
+	{
+		char* p = reinterpret_cast<char*>(buffer);
+		uint32_t done = 0;
+		while (done < size)
+		{
+#ifdef _WIN32
+			OVERLAPPED o = {};
+			o.Offset = DWORD(offset + done);
+			o.OffsetHigh = DWORD((offset + done) >> 32);
+			DWORD n = 0;
+			if (!ReadFile(reinterpret_cast<HANDLE>(file.handle), p + done, size - done, &n, &o))
+				return ERROR_HANDLE_EOF == GetLastError() ? int64_t(done) : -1;
+#else
+			ssize_t n = pread(int(file.handle), p + done, size - done, off_t(offset + done));
+			if (n < 0 && EINTR == errno)
+				continue;
+			if (n < 0)
+				return -1;
+#endif
+			if (0 == n)
+				break;
+			done += uint32_t(n);
+		}
+		return int64_t(done);
+	}
+
+#ifdef TOFU_IO_URING
+	// the three shared mappings of an io_uring instance
+	struct Ring
+	{
+		int				fd;
+		void*			sq;
+		size_t			sqSize;
+		void*			cq;
+		size_t			cqSize;
+		io_uring_sqe*	sqes;
+		size_t			sqesSize;
+
+		unsigned*		sqHead;
+		unsigned*		sqTail;
+		unsigned*		sqMask;
+		unsigned*		sqArray;
+		unsigned*		cqHead;
+		unsigned*		cqTail;
+		unsigned*		cqMask;
+		io_uring_cqe*	cqes;
+
+		uint32_t		entries;
+		uint32_t		unsubmitted;	// in the ring, not yet passed to the kernel
+	};
+
+	void ring_close(Ring& ring)
+	{
+		if (nullptr != ring.sqes)
+			munmap(ring.sqes, ring.sqesSize);
+		if (nullptr != ring.cq && ring.cq != ring.sq)
+			munmap(ring.cq, ring.cqSize);
+		if (nullptr != ring.sq)
+			munmap(ring.sq, ring.sqSize);
+		if (ring.fd >= 0)
+			close(ring.fd);
+		ring = Ring();
+		ring.fd = -1;
+	}
+
+	void* ring_map(int fd, size_t size, off_t offset)
+	{
+		void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+		return MAP_FAILED == p ? nullptr : p;
+	}
+
+	// fails where the kernel is too old or io_uring is disabled or filtered
+	bool ring_setup(Ring& ring, uint32_t depth)
+	{
+		ring = Ring();
+		ring.fd = -1;
+
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		ring.fd = int(syscall(__NR_io_uring_setup, depth, &params));
+		if (ring.fd < 0)
+			return false;
+
+		ring.sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		ring.cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool single = 0 != (params.features & IORING_FEAT_SINGLE_MMAP);
+		if (single)
+			ring.sqSize = ring.cqSize = std::max(ring.sqSize, ring.cqSize);
+
+		ring.sq = ring_map(ring.fd, ring.sqSize, IORING_OFF_SQ_RING);
+		ring.cq = single ? ring.sq : ring_map(ring.fd, ring.cqSize, IORING_OFF_CQ_RING);
+		ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		ring.sqes = reinterpret_cast<io_uring_sqe*>(ring_map(ring.fd, ring.sqesSize, IORING_OFF_SQES));
+		if (nullptr == ring.sq || nullptr == ring.cq || nullptr == ring.sqes)
+		{
+			ring_close(ring);
+			return false;
+		}
+
+		char* sq = reinterpret_cast<char*>(ring.sq);
+		char* cq = reinterpret_cast<char*>(ring.cq);
+		ring.sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+		ring.sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		ring.sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		ring.sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		ring.cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		ring.cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		ring.cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		ring.cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+		ring.entries = params.sq_entries;
+		return true;
+	}
+
+	// passes the queued entries to the kernel, waiting for minComplete
+	// completions when asked to
+	bool ring_enter(Ring& ring, uint32_t minComplete)
+	{
+		for (;;)
+		{
+			long ret = syscall(__NR_io_uring_enter, ring.fd, ring.unsubmitted, minComplete,
+				minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+			if (ret >= 0)
+			{
+				ring.unsubmitted -= uint32_t(ret);
+				return true;
+			}
+			if (EINTR != errno)
+				return false;
+		}
+	}
+#endif
+}
+
+namespace tofu
+{
+	struct IOQueue
+	{
+		uint32_t				pending;
+
+#ifdef TOFU_IO_URING
+		// a read in flight, one submission entry at a time, so the
+		// submission queue never overflows and the completion queue,
+		// twice its size, neither
+		struct Slot
+		{
+			ReadRequest			request;
+			uint32_t			done;
+			iovec				iov;
+		};
+
+		bool					uring;
+		Ring					ring;
+		std::vector<Slot>		slots;
+		std::vector<uint32_t>	freeSlots;
+		std::deque<ReadRequest>	waiting;	// beyond the depth
+#endif
+
+		std::vector<std::thread>	threads;
+		std::mutex					lock;
+		std::condition_variable		wake;		// a job or quit for the workers
+		std::condition_variable		finished;	// a completion for the owner
+		std::deque<ReadRequest>		jobs;
+		std::vector<Completion>		completed;
+		bool						quit;
+	};
+}
+
+namespace
+{
+	void worker(IOQueue* queue)
+	{
+		for (;;)
+		{
+			ReadRequest r;
+			{
+				std::unique_lock<std::mutex> guard(queue->lock);
+				queue->wake.wait(guard, [&] { return queue->quit || !queue->jobs.empty(); });
+				if (queue->jobs.empty())
+					return;
+				r = queue->jobs.front();
+				queue->jobs.pop_front();
+			}
+
+			int64_t result = read_at(*r.file, r.offset, r.buffer, r.size);
+
+			{
+				std::lock_guard<std::mutex> guard(queue->lock);
+				queue->completed.push_back(Completion{ r, result });
+			}
+			queue->finished.notify_one();
+		}
+	}
+
+#ifdef TOFU_IO_URING
+	// queues the rest of the read of slot, the kernel sees it on the next enter
+	void ring_read(IOQueue* queue, uint32_t slot)
+	{
+		Ring& ring = queue->ring;
+		IOQueue::Slot& s = queue->slots[slot];
+		s.iov.iov_base = reinterpret_cast<char*>(s.request.buffer) + s.done;
+		s.iov.iov_len = s.request.size - s.done;
+
+		unsigned tail = *ring.sqTail;
+		unsigned index = tail & *ring.sqMask;
+		io_uring_sqe& sqe = ring.sqes[index];
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_READV;
+		sqe.fd = int(s.request.file->handle);
+		sqe.off = s.request.offset + s.done;
+		sqe.addr = uint64_t(reinterpret_cast<uintptr_t>(&s.iov));
+		sqe.len = 1;
+		sqe.user_data = slot;
+		ring.sqArray[index] = index;
+		__atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+		ring.unsubmitted++;
+	}
+
+	void ring_fill(IOQueue* queue)
+	{
+		while (!queue->waiting.empty() && !queue->freeSlots.empty())
+		{
+			uint32_t slot = queue->freeSlots.back();
+			queue->freeSlots.pop_back();
+			queue->slots[slot].request = queue->waiting.front();
+			queue->slots[slot].done = 0;
+			queue->waiting.pop_front();
+			ring_read(queue, slot);
+		}
+
+		if (queue->ring.unsubmitted > 0)
+			ring_enter(queue->ring, 0);
+	}
+
+	// short reads before the end of the file and interrupted ones go back
+	// into the ring for the remainder
+	void ring_reap(IOQueue* queue, std::vector<Completion>& done)
+	{
+		Ring& ring = queue->ring;
+		unsigned head = *ring.cqHead;
+		unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++)
+		{
+			const io_uring_cqe& cqe = ring.cqes[head & *ring.cqMask];
+			uint32_t slot = uint32_t(cqe.user_data);
+			IOQueue::Slot& s = queue->slots[slot];
+
+			if (-EINTR == cqe.res || -EAGAIN == cqe.res)
+			{
+				ring_read(queue, slot);
+				continue;
+			}
+
+			if (cqe.res > 0)
+			{
+				s.done += uint32_t(cqe.res);
+				if (s.done < s.request.size)
+				{
+					ring_read(queue, slot);
+					continue;
+				}
+			}
+
+			done.push_back(Completion{ s.request, cqe.res < 0 ? -1 : int64_t(s.done) });
+			queue->freeSlots.push_back(slot);
+		}
+		__atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+
+		ring_fill(queue);
+	}
+#endif
+}
+
+namespace tofu
+{
+	int32_t open_io_file(const char* filename, IOFile& file)
+	{
+		file.handle = -1;
+		file.size = 0;
+
+#ifdef _WIN32
+		HANDLE h = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (INVALID_HANDLE_VALUE == h)
+			return -1;
+
+		LARGE_INTEGER size = {};
+		if (!GetFileSizeEx(h, &size))
+		{
+			CloseHandle(h);
+			return -1;
+		}
+		file.handle = reinterpret_cast<intptr_t>(h);
+		file.size = uint64_t(size.QuadPart);
+#else
+		int fd = open(filename, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return -1;
+
+		struct stat st;
+		if (0 != fstat(fd, &st))
+		{
+			close(fd);
+			return -1;
+		}
+		file.handle = fd;
+		file.size = uint64_t(st.st_size);
+#endif
+		return 0;
+	}
+
+	void close_io_file(IOFile& file)
+	{
+		if (file.handle != -1)
+		{
+#ifdef _WIN32
+			CloseHandle(reinterpret_cast<HANDLE>(file.handle));
+#else
+			close(int(file.handle));
+#endif
+		}
+		file.handle = -1;
+		file.size = 0;
+	}
+
+	IOQueue* create_io_queue(uint32_t depth, uint32_t numThreads)
+	{
+		depth = std::max(depth, 1u);
+
+		IOQueue* queue = new IOQueue();
+		queue->pending = 0;
+		queue->quit = false;
+
+#ifdef TOFU_IO_URING
+		queue->uring = ring_setup(queue->ring, depth);
+		if (queue->uring)
+		{
+			queue->slots.resize(queue->ring.entries);
+			for (uint32_t i = queue->ring.entries; i > 0; i--)
+				queue->freeSlots.push_back(i - 1);
+			return queue;
+		}
+#endif
+
+		if (0 == numThreads)
+			numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+		numThreads = std::min(numThreads, depth);
+		for (uint32_t i = 0; i < numThreads; i++)
+			queue->threads.push_back(std::thread(worker, queue));
+		return queue;
+	}
+
+	void destroy_io_queue(IOQueue* queue)
+	{
+		if (nullptr == queue)
+			return;
+
+		wait_reads(queue);
+
+		{
+			std::lock_guard<std::mutex> guard(queue->lock);
+			queue->quit = true;
+		}
+		queue->wake.notify_all();
+		for (std::thread& t : queue->threads)
+			t.join();
+
+#ifdef TOFU_IO_URING
+		if (queue->uring)
+			ring_close(queue->ring);
+#endif
+
+		delete queue;
+	}
+
+	int32_t submit_reads(IOQueue* queue, const ReadRequest* requests, uint32_t count)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const ReadRequest& r = requests[i];
+			if (nullptr == r.file || -1 == r.file->handle || (nullptr == r.buffer && r.size > 0))
+				return -1;
+		}
+
+		queue->pending += count;
+
+#ifdef TOFU_IO_URING
+		if (queue->uring)
+		{
+			queue->waiting.insert(queue->waiting.end(), requests, requests + count);
+			ring_fill(queue);
+			return 0;
+		}
+#endif
+
+		{
+			std::lock_guard<std::mutex> guard(queue->lock);
+			queue->jobs.insert(queue->jobs.end(), requests, requests + count);
+		}
+		queue->wake.notify_all();
+		return 0;
+	}
+
+	uint32_t poll_reads(IOQueue* queue)
+	{
+		// taken out first, callbacks may submit and poll again
+		std::vector<Completion> done;
+#ifdef TOFU_IO_URING
+		if (queue->uring)
+			ring_reap(queue, done);
+		else
+#endif
+		{
+			std::lock_guard<std::mutex> guard(queue->lock);
+			done.swap(queue->completed);
+		}
+
+		for (const Completion& c : done)
+		{
+			queue->pending--;
+			if (nullptr != c.request.callback)
+				c.request.callback(c.request.user, c.result);
+		}
+		return uint32_t(done.size());
+	}
+
+	void wait_reads(IOQueue* queue)
+	{
+		while (queue->pending > 0)
+		{
+			if (poll_reads(queue) > 0)
+				continue;
+
+#ifdef TOFU_IO_URING
+			if (queue->uring)
+			{
+				if (!ring_enter(queue->ring, 1))
+					std::this_thread::yield();
+				continue;
+			}
+#endif
+
+			std::unique_lock<std::mutex> guard(queue->lock);
+			queue->finished.wait(guard, [&] { return !queue->completed.empty(); });
+		}
+	}
+
+	uint32_t pending_reads(const IOQueue* queue)
+	{
+		return queue->pending;
+	}
+
+	const char* io_backend(const IOQueue* queue)
+	{
+#ifdef TOFU_IO_URING
+		if (queue->uring)
+			return "io_uring";
+#endif
+		return "threads";
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace tofu
+{
+	// a file opened for reading through an IOQueue
+	struct IOFile
+	{
+		intptr_t	handle;		// HANDLE on Windows, a descriptor elsewhere
+		uint64_t	size;
+	};
+
+	// returns 0 on success
+	int32_t open_io_file(const char* filename, IOFile& file);
+
+	// safe to call on a closed or failed IOFile, no read of it may be pending
+	void close_io_file(IOFile& file);
+
+	// result is the number of bytes read, less than asked for only at the
+	// end of the file, or -1 on error
+	typedef void(*ReadCallback)(void* user, int64_t result);
+
+	// buffer is owned by the caller and must stay valid until the callback,
+	// align it to TFModelAlignment to validate a TFModel in place
+	struct ReadRequest
+	{
+		const IOFile*	file;
+		uint64_t		offset;
+		void*			buffer;
+		uint32_t		size;
+		ReadCallback	callback;
+		void*			user;
+	};
+
+	// reads run in the background, io_uring on Linux when the kernel allows
+	// it and a pool of threads doing positioned reads otherwise. Callbacks
+	// run on the thread calling poll_reads or wait_reads, so they may touch
+	// whatever that thread owns, and may submit more reads. One thread
+	// drives a queue
+	struct IOQueue;
+
+	// depth bounds the reads in flight, more are held back until one ends.
+	// numThreads is for the fallback, 0 picks one per core
+	IOQueue* create_io_queue(uint32_t depth, uint32_t numThreads = 0);
+
+	// waits for every read, callbacks included
+	void destroy_io_queue(IOQueue* queue);
+
+	// queues count reads in one batch, returns 0 on success
+	int32_t submit_reads(IOQueue* queue, const ReadRequest* requests, uint32_t count);
+
+	// runs the callbacks of finished reads without blocking, returns how many
+	uint32_t poll_reads(IOQueue* queue);
+
+	// blocks until every submitted read has finished and run its callback
+	void wait_reads(IOQueue* queue);
+
+	// submitted reads whose callback has not run yet
+	uint32_t pending_reads(const IOQueue* queue);
+
+	// "io_uring" or "threads"
+	const char* io_backend(const IOQueue* queue);
+}
@@ -1,8 +1,41 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
 #include <cmath>
 
+// SIMD code paths are selected at compile time. Define TOFU_MATH_NO_SIMD to
+// force the scalar fallback, which matches them within rounding: the order
+// of operations differs, and with FMA enabled (-mfma, /arch:AVX2) the
+// compiler may contract a multiply and add in one path and not the other.
+#if !defined(TOFU_MATH_NO_SIMD)
+#	if defined(__AVX2__)
+#		define TOFU_MATH_AVX2 1
+#	endif
+#	if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#		define TOFU_MATH_SSE2 1
+#	endif
+// every AVX2 CPU has F16C, MSVC does not define __F16C__
+#	if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#		define TOFU_MATH_F16C 1
+#	endif
+#endif
+
+// functions with more than a single return statement need C++14 constexpr,
+// which Visual Studio 2015 does not support
+#if defined(_MSC_VER) && _MSC_VER < 1910
+#	define TOFU_CONSTEXPR14 inline
+#else
+#	define TOFU_CONSTEXPR14 constexpr
+#endif
+
+#if defined(TOFU_MATH_AVX2) || defined(TOFU_MATH_F16C)
+#include <immintrin.h>
+#elif defined(TOFU_MATH_SSE2)
+#include <emmintrin.h>
+#endif
+
 namespace tofu
 {
 	namespace math
@@ -43,6 +76,62 @@ namespace tofu
 			float4 w;
 		};
 
+		// affine matrix, a float4x4 whose last row is (0, 0, 0, 1)
+		// same layout as Bone::matrix and Mesh::matrix
+		struct float3x4
+		{
+			float4 x;
+			float4 y;
+			float4 z;
+		};
+
+		// unit dual quaternion, real part is the rotation,
+		// dual part is 0.5 * (t, 0) * real for a translation t
+		struct dualquat
+		{
+			float4 real;
+			float4 dual;
+		};
+
+		struct aabb
+		{
+			float3 min;
+			float3 max;
+		};
+
+		// same layout as float4
+		struct sphere
+		{
+			float3 center;
+			float radius;
+		};
+
+		// points with dot(normal, p) + d >= 0 are on the inner side
+		struct plane
+		{
+			float3 normal;
+			float d;
+		};
+
+		// left, right, bottom, top, near, far
+		struct frustum
+		{
+			plane planes[6];
+		};
+
+		// smallest three quaternion, 15 bits per component, see packQuat48
+		struct quat48
+		{
+			uint16_t bits[3];
+		};
+
+		enum Containment : uint8_t
+		{
+			Outside = 0,
+			Intersecting = 1,
+			Inside = 2
+		};
+
 		typedef vec2<int32_t>	int2;
 		typedef vec3<int32_t>	int3;
 		typedef vec4<int32_t>	int4;
@@ -53,84 +142,84 @@ namespace tofu
 
 		// float2
 
-		inline float2& operator += (float2& a, const float2 b)
+		TOFU_CONSTEXPR14 float2& operator += (float2& a, const float2 b)
 		{
 			a.x += b.x;
 			a.y += b.y;
 			return a;
 		}
 
-		inline float2& operator -= (float2& a, const float2 b)
+		TOFU_CONSTEXPR14 float2& operator -= (float2& a, const float2 b)
 		{
 			a.x -= b.x;
 			a.y -= b.y;
 			return a;
 		}
 
-		inline float2& operator *= (float2& a, const float2 b)
+		TOFU_CONSTEXPR14 float2& operator *= (float2& a, const float2 b)
 		{
 			a.x *= b.x;
 			a.y *= b.y;
 			return a;
 		}
 
-		inline float2& operator *= (float2& a, float b)
+		TOFU_CONSTEXPR14 float2& operator *= (float2& a, float b)
 		{
 			a.x *= b;
 			a.y *= b;
 			return a;
 		}
 
-		inline float2& operator /= (float2& a, float b)
+		TOFU_CONSTEXPR14 float2& operator /= (float2& a, float b)
 		{
 			a.x /= b;
 			a.y /= b;
 			return a;
 		}
 
-		inline float2 operator + (const float2& a, const float2& b)
+		constexpr float2 operator + (const float2& a, const float2& b)
 		{
 			return float2{ a.x + b.x, a.y + b.y };
 		}
 
-		inline float2 operator - (const float2& a, const float2& b)
+		constexpr float2 operator - (const float2& a, const float2& b)
 		{
 			return float2{ a.x - b.x, a.y - b.y };
 		}
 
-		inline float2 operator * (const float2& a, const float2& b)
+		constexpr float2 operator * (const float2& a, const float2& b)
 		{
 			return float2{ a.x * b.x, a.y * b.y };
 		}
 
-		inline float2 operator * (const float2& a, float b)
+		constexpr float2 operator * (const float2& a, float b)
 		{
 			return float2{ a.x * b, a.y * b };
 		}
 
-		inline float2 operator * (float a, const float2& b)
+		constexpr float2 operator * (float a, const float2& b)
 		{
 			return float2{ a * b.x, a * b.y };
 		}
 
-		inline float2 operator / (const float2& a, float b)
+		constexpr float2 operator / (const float2& a, float b)
 		{
 			return float2{ a.x / b, a.y / b };
 		}
 
-		inline float dot(const float2& a, const float2& b)
+		constexpr float dot(const float2& a, const float2& b)
 		{
 			return a.x * b.x + a.y * b.y;
 		}
 
-		inline float cross(const float2& a, const float2& b)
+		constexpr float cross(const float2& a, const float2& b)
 		{
 			return a.x * b.y - a.y * b.x;
 		}
 
 		inline float length(const float2& a)
 		{
-			return std::sqrtf(a.x * a.x + a.y * a.y);
+			return std::sqrt(a.x * a.x + a.y * a.y);
 		}
 
 		inline float2 normalize(const float2& a)
@@ -142,7 +231,7 @@ namespace tofu
 
 		// float3
 
-		inline float3& operator += (float3& a, const float3 b)
+		TOFU_CONSTEXPR14 float3& operator += (float3& a, const float3 b)
 		{
 			a.x += b.x;
 			a.y += b.y;
@@ -150,7 +239,7 @@ namespace tofu
 			return a;
 		}
 
-		inline float3& operator -= (float3& a, const float3 b)
+		TOFU_CONSTEXPR14 float3& operator -= (float3& a, const float3 b)
 		{
 			a.x -= b.x;
 			a.y -= b.y;
@@ -158,7 +247,7 @@ namespace tofu
 			return a;
 		}
 
-		inline float3& operator *= (float3& a, const float3 b)
+		TOFU_CONSTEXPR14 float3& operator *= (float3& a, const float3 b)
 		{
 			a.x *= b.x;
 			a.y *= b.y;
@@ -166,7 +255,7 @@ namespace tofu
 			return a;
 		}
 
-		inline float3& operator *= (float3& a, float b)
+		TOFU_CONSTEXPR14 float3& operator *= (float3& a, float b)
 		{
 			a.x *= b;
 			a.y *= b;
@@ -174,7 +263,7 @@ namespace tofu
 			return a;
 		}
 
-		inline float3& operator /= (float3& a, float b)
+		TOFU_CONSTEXPR14 float3& operator /= (float3& a, float b)
 		{
 			a.x /= b;
 			a.y /= b;
@@ -182,42 +271,42 @@ namespace tofu
 			return a;
 		}
 
-		inline float3 operator + (const float3& a, const float3& b)
+		constexpr float3 operator + (const float3& a, const float3& b)
 		{
 			return float3{ a.x + b.x, a.y + b.y, a.z + b.z };
 		}
 
-		inline float3 operator - (const float3& a, const float3& b)
+		constexpr float3 operator - (const float3& a, const float3& b)
 		{
 			return float3{ a.x - b.x, a.y - b.y, a.z - b.z };
 		}
 
-		inline float3 operator * (const float3& a, const float3& b)
+		constexpr float3 operator * (const float3& a, const float3& b)
 		{
 			return float3{ a.x * b.x, a.y * b.y, a.z * b.z };
 		}
 
-		inline float3 operator * (const float3& a, float b)
+		constexpr float3 operator * (const float3& a, float b)
 		{
 			return float3{ a.x * b, a.y * b, a.z * b };
 		}
 
-		inline float3 operator * (float a, const float3& b)
+		constexpr float3 operator * (float a, const float3& b)
 		{
 			return float3{ a * b.x, a * b.y, a * b.z };
 		}
 
-		inline float3 operator / (const float3& a, float b)
+		constexpr float3 operator / (const float3& a, float b)
 		{
 			return float3{ a.x / b, a.y / b, a.z / b };
 		}
 
-		inline float dot(const float3& a, const float3& b)
+		constexpr float dot(const float3& a, const float3& b)
 		{
 			return a.x * b.x + a.y * b.y + a.z * b.z;
 		}
 
-		inline float3 cross(const float3& a, const float3& b)
+		constexpr float3 cross(const float3& a, const float3& b)
 		{
 			return float3{
 				a.y * b.z - a.z * b.y,
@@ -228,7 +317,7 @@ namespace tofu
 
 		inline float length(const float3& a)
 		{
-			return std::sqrtf(a.x * a.x + a.y * a.y + a.z * a.z);
+			return std::sqrt(a.x * a.x + a.y * a.y + a.z * a.z);
 		}
 
 		inline float3 normalize(const float3& a)
@@ -240,7 +329,7 @@ namespace tofu
 
 		// float4
 
-		inline float4& operator += (float4& a, const float4 b)
+		TOFU_CONSTEXPR14 float4& operator += (float4& a, const float4 b)
 		{
 			a.x += b.x;
 			a.y += b.y;
@@ -249,7 +338,7 @@ namespace tofu
 			return a;
 		}
 
-		inline float4& operator -= (float4& a, const float4 b)
+		TOFU_CONSTEXPR14 float4& operator -= (float4& a, const float4 b)
 		{
 			a.x -= b.x;
 			a.y -= b.y;
@@ -258,7 +347,7 @@ namespace tofu
 			return a;
 		}
 
-		inline float4& operator *= (float4& a, const float4 b)
+		TOFU_CONSTEXPR14 float4& operator *= (float4& a, const float4 b)
 		{
 			a.x *= b.x;
 			a.y *= b.y;
@@ -267,7 +356,7 @@ namespace tofu
 			return a;
 		}
 
-		inline float4& operator *= (float4& a, float b)
+		TOFU_CONSTEXPR14 float4& operator *= (float4& a, float b)
 		{
 			a.x *= b;
 			a.y *= b;
@@ -276,7 +365,7 @@ namespace tofu
 			return a;
 		}
 
-		inline float4& operator /= (float4& a, float b)
+		TOFU_CONSTEXPR14 float4& operator /= (float4& a, float b)
 		{
 			a.x /= b;
 			a.y /= b;
@@ -285,44 +374,44 @@ namespace tofu
 			return a;
 		}
 
-		inline float4 operator + (const float4& a, const float4& b)
+		constexpr float4 operator + (const float4& a, const float4& b)
 		{
 			return float4{ a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w };
 		}
 
-		inline float4 operator - (const float4& a, const float4& b)
+		constexpr float4 operator - (const float4& a, const float4& b)
 		{
 			return float4{ a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w };
 		}
 
-		inline float4 operator * (const float4& a, const float4& b)
+		constexpr float4 operator * (const float4& a, const float4& b)
 		{
 			return float4{ a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w };
 		}
 
-		inline float4 operator * (const float4& a, float b)
+		constexpr float4 operator * (const float4& a, float b)
 		{
 			return float4{ a.x * b, a.y * b, a.z * b, a.w * b };
 		}
 
-		inline float4 operator * (float a, const float4& b)
+		constexpr float4 operator * (float a, const float4& b)
 		{
 			return float4{ a * b.x, a * b.y, a * b.z, a * b.w };
 		}
 
-		inline float4 operator / (const float4& a, float b)
+		constexpr float4 operator / (const float4& a, float b)
 		{
 			return float4{ a.x / b, a.y / b, a.z / b, a.w / b };
 		}
 
 		// w is ignored
-		inline float dot(const float4& a, const float4& b)
+		constexpr float dot(const float4& a, const float4& b)
 		{
 			return a.x * b.x + a.y * b.y + a.z * b.z;
 		}
 
 		// w is ignored
-		inline float4 cross(const float4& a, const float4& b)
+		constexpr float4 cross(const float4& a, const float4& b)
 		{
 			return float4{
 				a.y * b.z - a.z * b.y,
@@ -334,7 +423,7 @@ namespace tofu
 		// w is ignored
 		inline float length(const float4& a)
 		{
-			return std::sqrtf(a.x * a.x + a.y * a.y + a.z * a.z);
+			return std::sqrt(a.x * a.x + a.y * a.y + a.z * a.z);
 		}
 
 		// w is ignored
@@ -348,25 +437,141 @@ namespace tofu
 
 		inline float4 quat(float theta, const float3& axis)
 		{
-			float s = std::sinf(theta * 0.5f);
-			float c = std::cosf(theta * 0.5f);
+			float s = std::sin(theta * 0.5f);
+			float c = std::cos(theta * 0.5f);
 			return float4{ s * axis.x, s * axis.y, s * axis.z, c };
 		}
 
 		inline float4 quat(float pitch, float yaw, float roll)
 		{
-			float sp = std::sinf(pitch);
-			float sy = std::sinf(yaw);
-			float cp = std::cosf(pitch);
-			float cy = std::cosf(yaw);
+			float sp = std::sin(pitch);
+			float sy = std::sin(yaw);
+			float cp = std::cos(pitch);
+			float cy = std::cos(yaw);
 			return quat(roll, float3{cp * sy, sp, cp * cy});
 		}
 
+		constexpr float4 quatIdentity()
+		{
+			return float4{ 0.0f, 0.0f, 0.0f, 1.0f };
+		}
+
+		// 4 component dot, unlike dot(float4, float4)
+		constexpr float quatDot(const float4& a, const float4& b)
+		{
+			return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+		}
+
+		// a * b rotates by b first, then by a
+		constexpr float4 quatMul(const float4& a, const float4& b)
+		{
+			return float4{
+				a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+				a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+				a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+				a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+			};
+		}
+
+		constexpr float4 conjugate(const float4& q)
+		{
+			return float4{ -q.x, -q.y, -q.z, q.w };
+		}
+
+		constexpr float4 quatInverse(const float4& q)
+		{
+			return conjugate(q) / quatDot(q, q);
+		}
+
+		inline float4 quatNormalize(const float4& q)
+		{
+			return q / std::sqrt(quatDot(q, q));
+		}
+
+		// q * v * q^-1 for a unit quaternion
+		TOFU_CONSTEXPR14 float3 quatRotate(const float4& q, const float3& v)
+		{
+			float3 u{ q.x, q.y, q.z };
+			float3 t = cross(u, v) * 2.0f;
+			return v + t * q.w + cross(u, t);
+		}
+
+		// q or -q, whichever is on the same hemisphere as ref
+		constexpr float4 alignHemisphere(const float4& ref, const float4& q)
+		{
+			return quatDot(ref, q) < 0.0f ? q * -1.0f : q;
+		}
+
+		// makes every key lie on the hemisphere of the previous one, so that
+		// interpolating neighbours always takes the short path
+		inline void alignHemisphere(float4* q, size_t n)
+		{
+			for (size_t i = 1; i < n; i++)
+			{
+				q[i] = alignHemisphere(q[i - 1], q[i]);
+			}
+		}
+
+		// normalized lerp along the shorter arc, constant velocity is not preserved
+		inline float4 nlerp(const float4& a, const float4& b, float t)
+		{
+			float wb = quatDot(a, b) < 0.0f ? -t : t;
+			return quatNormalize(a * (1.0f - t) + b * wb);
+		}
+
+		// spherical interpolation along the shorter arc
+		inline float4 slerp(const float4& a, const float4& b, float t)
+		{
+			float d = quatDot(a, b);
+			float sign = 1.0f;
+			if (d < 0.0f)
+			{
+				d = -d;
+				sign = -1.0f;
+			}
+
+			// nearly parallel, sin(theta) is too small to divide by
+			if (d > 0.9995f)
+			{
+				return nlerp(a, b, t);
+			}
+
+			float theta = std::acos(d);
+			float invSin = 1.0f / std::sin(theta);
+			float wa = std::sin((1.0f - t) * theta) * invSin;
+			float wb = std::sin(t * theta) * invSin * sign;
+			return a * wa + b * wb;
+		}
+
+		namespace detail
+		{
+			// reshapes t so that nlerp follows the slerp arc
+			// a and b are polynomial fits of the nlerp velocity error against |cos(theta)|
+			inline float slerp_correction(float t, float d)
+			{
+				float a = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+				float b = 0.848013f + d * (-1.06021f + d * 0.215638f);
+				float k = a * (t - 0.5f) * (t - 0.5f) + b;
+				return t + t * (t - 0.5f) * (t - 1.0f) * k;
+			}
+		}
+
+		// nlerp with a corrected t, no transcendental functions
+		// maximum angular error against slerp is below 2e-3 radians over the whole range
+		inline float4 slerpApprox(const float4& a, const float4& b, float t)
+		{
+			float d = quatDot(a, b);
+			return nlerp(a, b, detail::slerp_correction(t, std::fabs(d)));
+		}
+
 		// float4x4
 
+		// constexpr products, always scalar
+		// operator * computes the same products within rounding and picks the
+		// SIMD paths where they are compiled in
+
 		// row vector
-		// TODO optimize it
-		inline float4 operator * (const float4& a, const float4x4& b)
+		constexpr float4 mul(const float4& a, const float4x4& b)
 		{
 			return float4{
 				a.x * b.x.x + a.y * b.y.x + a.z * b.z.x + a.w * b.w.x,
@@ -377,29 +582,120 @@ namespace tofu
 		}
 
 		// column vector
-		// TODO optimize it
-		inline float4 operator * (const float4x4& a, const float4& b)
+		constexpr float4 mul(const float4x4& a, const float4& b)
 		{
 			return float4{
 				a.x.x * b.x + a.x.y * b.y + a.x.z * b.z + a.x.w * b.w,
 				a.y.x * b.x + a.y.y * b.y + a.y.z * b.z + a.y.w * b.w,
-				a.z.x * b.x + a.x.y * b.y + a.z.z * b.z + a.z.w * b.w,
+				a.z.x * b.x + a.z.y * b.y + a.z.z * b.z + a.z.w * b.w,
 				a.w.x * b.x + a.w.y * b.y + a.w.z * b.z + a.w.w * b.w
 			};
 		}
 
-		// TODO optimize it
+		constexpr float4x4 mul(const float4x4& a, const float4x4& b)
+		{
+			return float4x4{ mul(a.x, b), mul(a.y, b), mul(a.z, b), mul(a.w, b) };
+		}
+
+#if defined(TOFU_MATH_SSE2)
+		namespace detail
+		{
+			inline __m128 load(const float4& a)
+			{
+				return _mm_loadu_ps(&a.x);
+			}
+
+			inline float4 store(__m128 a)
+			{
+				float4 r;
+				_mm_storeu_ps(&r.x, a);
+				return r;
+			}
+
+			// a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w, summed in the
+			// same order as the scalar code
+			inline __m128 mul_row(__m128 a, __m128 b0, __m128 b1, __m128 b2, __m128 b3)
+			{
+				__m128 r = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+				return r;
+			}
+		}
+#endif
+
+		// row vector
+		inline float4 operator * (const float4& a, const float4x4& b)
+		{
+#if defined(TOFU_MATH_SSE2)
+			return detail::store(detail::mul_row(detail::load(a),
+				detail::load(b.x), detail::load(b.y), detail::load(b.z), detail::load(b.w)));
+#else
+			return mul(a, b);
+#endif
+		}
+
+		// column vector
+		inline float4 operator * (const float4x4& a, const float4& b)
+		{
+#if defined(TOFU_MATH_SSE2)
+			// transpose a, then it is a row vector product
+			__m128 c0 = detail::load(a.x);
+			__m128 c1 = detail::load(a.y);
+			__m128 c2 = detail::load(a.z);
+			__m128 c3 = detail::load(a.w);
+			_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+			return detail::store(detail::mul_row(detail::load(b), c0, c1, c2, c3));
+#else
+			return mul(a, b);
+#endif
+		}
+
 		inline float4x4 operator * (const float4x4& a, const float4x4& b)
 		{
+#if defined(TOFU_MATH_AVX2)
+			// two rows of a per register, each row of b broadcast to both lanes
+			const __m128* pb = reinterpret_cast<const __m128*>(&b.x.x);
+			__m256 b0 = _mm256_broadcast_ps(pb);
+			__m256 b1 = _mm256_broadcast_ps(pb + 1);
+			__m256 b2 = _mm256_broadcast_ps(pb + 2);
+			__m256 b3 = _mm256_broadcast_ps(pb + 3);
+
+			__m256 a01 = _mm256_loadu_ps(&a.x.x);
+			__m256 a23 = _mm256_loadu_ps(&a.z.x);
+
+			__m256 r01 = _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+			__m256 r23 = _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+			r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+			r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+			r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+			r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+			r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+			r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+
+			float4x4 r;
+			_mm256_storeu_ps(&r.x.x, r01);
+			_mm256_storeu_ps(&r.z.x, r23);
+			return r;
+#elif defined(TOFU_MATH_SSE2)
+			__m128 b0 = detail::load(b.x);
+			__m128 b1 = detail::load(b.y);
+			__m128 b2 = detail::load(b.z);
+			__m128 b3 = detail::load(b.w);
+
 			return float4x4{
-				operator * (a.x, b),
-				operator * (a.y, b),
-				operator * (a.z, b),
-				operator * (a.w, b)
+				detail::store(detail::mul_row(detail::load(a.x), b0, b1, b2, b3)),
+				detail::store(detail::mul_row(detail::load(a.y), b0, b1, b2, b3)),
+				detail::store(detail::mul_row(detail::load(a.z), b0, b1, b2, b3)),
+				detail::store(detail::mul_row(detail::load(a.w), b0, b1, b2, b3))
 			};
+#else
+			return mul(a, b);
+#endif
 		}
 
-		inline float4x4 transpose(const float4x4& a)
+		constexpr float4x4 transpose(const float4x4& a)
 		{
 			return float4x4{
 				float4{ a.x.x, a.y.x, a.z.x, a.w.x },
@@ -409,7 +705,7 @@ namespace tofu
 			};
 		}
 
-		inline float4x4 identity()
+		constexpr float4x4 identity()
 		{
 			return float4x4{
 				float4{ 1.0f, 0.0f, 0.0f, 0.0f },
@@ -419,7 +715,7 @@ namespace tofu
 			};
 		}
 
-		inline float4x4 translate(const float3& t)
+		constexpr float4x4 translate(const float3& t)
 		{
 			return float4x4{
 				float4{ 1.0f, 0.0f, 0.0f, t.x },
@@ -429,7 +725,7 @@ namespace tofu
 			};
 		}
 
-		inline float4x4 translate(float x, float y, float z)
+		constexpr float4x4 translate(float x, float y, float z)
 		{
 			return float4x4{
 				float4{ 1.0f, 0.0f, 0.0f, x },
@@ -439,7 +735,7 @@ namespace tofu
 			};
 		}
 
-		inline float4x4 rotate(const float4& q)
+		TOFU_CONSTEXPR14 float4x4 rotate(const float4& q)
 		{
 			float a_sqr = q.w * q.w;
 			float b_sqr = q.x * q.x;
@@ -463,7 +759,7 @@ namespace tofu
 			};
 		}
 
-		inline float4x4 scale(const float3& s)
+		constexpr float4x4 scale(const float3& s)
 		{
 			return float4x4{
 				float4{ s.x, 0.0f, 0.0f, 0.0f },
@@ -473,7 +769,7 @@ namespace tofu
 			};
 		}
 
-		inline float4x4 scale(float s)
+		constexpr float4x4 scale(float s)
 		{
 			return float4x4{
 				float4{ s, 0.0f, 0.0f, 0.0f },
@@ -483,7 +779,7 @@ namespace tofu
 			};
 		}
 
-		inline float4x4 scale(float x, float y, float z)
+		constexpr float4x4 scale(float x, float y, float z)
 		{
 			return float4x4{
 				float4{ x, 0.0f, 0.0f, 0.0f },
@@ -511,19 +807,2791 @@ namespace tofu
 			return lookTo(position, target - position, up);
 		}
 
-		inline float4x4 perspective(float fov, float aspect, float zNear, float zFar)
+		// yScale is 1 / tan(fov / 2), xScale is yScale / aspect
+		constexpr float4x4 perspectiveScale(float xScale, float yScale, float zNear, float zFar)
 		{
-			float yScale = 1.0f / std::tanf(fov * 0.5f);
-			float xScale = yScale / aspect;
-			float zScale = zFar / (zFar - zNear);
-			float zOffset = zFar * zNear / (zNear - zFar);
-
 			return float4x4{
 				float4{ xScale, 0.0f, 0.0f, 0.0f },
 				float4{ 0.0f, yScale, 0.0f, 0.0f },
-				float4{ 0.0f, 0.0f, zScale, zOffset },
-				float4{ 0.0f, 0.0f, 1.0, 0.0f }
+				float4{ 0.0f, 0.0f, zFar / (zFar - zNear), zFar * zNear / (zNear - zFar) },
+				float4{ 0.0f, 0.0f, 1.0f, 0.0f }
+			};
+		}
+
+		inline float4x4 perspective(float fov, float aspect, float zNear, float zFar)
+		{
+			float yScale = 1.0f / std::tan(fov * 0.5f);
+			return perspectiveScale(yScale / aspect, yScale, zNear, zFar);
+		}
+
+		// float3x4
+
+		constexpr float3x4 identity3x4()
+		{
+			return float3x4{
+				float4{ 1.0f, 0.0f, 0.0f, 0.0f },
+				float4{ 0.0f, 1.0f, 0.0f, 0.0f },
+				float4{ 0.0f, 0.0f, 1.0f, 0.0f }
+			};
+		}
+
+		// drops the last row
+		constexpr float3x4 toFloat3x4(const float4x4& a)
+		{
+			return float3x4{ a.x, a.y, a.z };
+		}
+
+		constexpr float4x4 toFloat4x4(const float3x4& a)
+		{
+			return float4x4{ a.x, a.y, a.z, float4{ 0.0f, 0.0f, 0.0f, 1.0f } };
+		}
+
+		namespace detail
+		{
+			constexpr float4 mul_row_affine(const float4& a, const float3x4& b)
+			{
+				return float4{
+					a.x * b.x.x + a.y * b.y.x + a.z * b.z.x,
+					a.x * b.x.y + a.y * b.y.y + a.z * b.z.y,
+					a.x * b.x.z + a.y * b.y.z + a.z * b.z.z,
+					a.x * b.x.w + a.y * b.y.w + a.z * b.z.w + a.w
+				};
+			}
+		}
+
+		// constexpr, always scalar
+		constexpr float3x4 mul(const float3x4& a, const float3x4& b)
+		{
+			return float3x4{
+				detail::mul_row_affine(a.x, b),
+				detail::mul_row_affine(a.y, b),
+				detail::mul_row_affine(a.z, b)
+			};
+		}
+
+#if defined(TOFU_MATH_SSE2)
+		namespace detail
+		{
+			inline __m128 mask_w()
+			{
+				return _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+			}
+
+			// a.yzx * b.zxy - a.zxy * b.yzx, w is 0
+			inline __m128 cross3(__m128 a, __m128 b)
+			{
+				__m128 a1 = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+				__m128 b1 = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+				__m128 c = _mm_sub_ps(_mm_mul_ps(a, b1), _mm_mul_ps(a1, b));
+				return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+			}
+
+			// xyz dot product broadcast to all lanes
+			inline __m128 dot3(__m128 a, __m128 b)
+			{
+				__m128 m = _mm_mul_ps(a, b);
+				__m128 x = _mm_shuffle_ps(m, m, _MM_SHUFFLE(0, 0, 0, 0));
+				__m128 y = _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1));
+				__m128 z = _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2));
+				return _mm_add_ps(_mm_add_ps(x, y), z);
+			}
+
+			// row of a * b, where b has an implied (0, 0, 0, 1) last row
+			inline __m128 mul_row_affine(__m128 a, __m128 b0, __m128 b1, __m128 b2)
+			{
+				__m128 r = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+				return _mm_add_ps(r, _mm_and_ps(a, mask_w()));
+			}
+
+			// m * (x, y, z, w), only xyz of the result are meaningful
+			inline __m128 transform_affine(const float3x4& m, __m128 v)
+			{
+				__m128 c0 = load(m.x);
+				__m128 c1 = load(m.y);
+				__m128 c2 = load(m.z);
+				__m128 c3 = _mm_setzero_ps();
+				_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+				__m128 r = _mm_mul_ps(c0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+				r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+				r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+				r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+				return r;
+			}
+		}
+#endif
+
+		// a * b as 4x4 matrices, without the constant last row
+		inline float3x4 operator * (const float3x4& a, const float3x4& b)
+		{
+#if defined(TOFU_MATH_SSE2)
+			__m128 b0 = detail::load(b.x);
+			__m128 b1 = detail::load(b.y);
+			__m128 b2 = detail::load(b.z);
+
+			return float3x4{
+				detail::store(detail::mul_row_affine(detail::load(a.x), b0, b1, b2)),
+				detail::store(detail::mul_row_affine(detail::load(a.y), b0, b1, b2)),
+				detail::store(detail::mul_row_affine(detail::load(a.z), b0, b1, b2))
+			};
+#else
+			return mul(a, b);
+#endif
+		}
+
+		// column vector, (p, 1)
+		inline float3 transformPoint(const float3x4& m, const float3& p)
+		{
+#if defined(TOFU_MATH_SSE2)
+			float4 r = detail::store(detail::transform_affine(m, _mm_set_ps(1.0f, p.z, p.y, p.x)));
+			return float3{ r.x, r.y, r.z };
+#else
+			return float3{
+				m.x.x * p.x + m.x.y * p.y + m.x.z * p.z + m.x.w,
+				m.y.x * p.x + m.y.y * p.y + m.y.z * p.z + m.y.w,
+				m.z.x * p.x + m.z.y * p.y + m.z.z * p.z + m.z.w
+			};
+#endif
+		}
+
+		// column vector, (v, 0), translation is ignored
+		inline float3 transformVector(const float3x4& m, const float3& v)
+		{
+#if defined(TOFU_MATH_SSE2)
+			float4 r = detail::store(detail::transform_affine(m, _mm_set_ps(0.0f, v.z, v.y, v.x)));
+			return float3{ r.x, r.y, r.z };
+#else
+			return float3{
+				m.x.x * v.x + m.x.y * v.y + m.x.z * v.z,
+				m.y.x * v.x + m.y.y * v.y + m.y.z * v.z,
+				m.z.x * v.x + m.z.y * v.y + m.z.z * v.z
+			};
+#endif
+		}
+
+		// inverse of an affine matrix, the 3x3 part must not be singular
+		// inverse of [A | t] is [A^-1 | -A^-1 * t], A^-1 is built from cross products of the rows
+		inline float3x4 inverse(const float3x4& m)
+		{
+#if defined(TOFU_MATH_SSE2)
+			__m128 r0 = detail::load(m.x);
+			__m128 r1 = detail::load(m.y);
+			__m128 r2 = detail::load(m.z);
+
+			__m128 c0 = detail::cross3(r1, r2);
+			__m128 c1 = detail::cross3(r2, r0);
+			__m128 c2 = detail::cross3(r0, r1);
+
+			__m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), detail::dot3(r0, c0));
+			c0 = _mm_mul_ps(c0, invDet);
+			c1 = _mm_mul_ps(c1, invDet);
+			c2 = _mm_mul_ps(c2, invDet);
+
+			__m128 t = _mm_mul_ps(c0, _mm_shuffle_ps(r0, r0, _MM_SHUFFLE(3, 3, 3, 3)));
+			t = _mm_add_ps(t, _mm_mul_ps(c1, _mm_shuffle_ps(r1, r1, _MM_SHUFFLE(3, 3, 3, 3))));
+			t = _mm_add_ps(t, _mm_mul_ps(c2, _mm_shuffle_ps(r2, r2, _MM_SHUFFLE(3, 3, 3, 3))));
+			__m128 c3 = _mm_sub_ps(_mm_setzero_ps(), t);
+
+			_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+			return float3x4{ detail::store(c0), detail::store(c1), detail::store(c2) };
+#else
+			float3 a0{ m.x.x, m.x.y, m.x.z };
+			float3 a1{ m.y.x, m.y.y, m.y.z };
+			float3 a2{ m.z.x, m.z.y, m.z.z };
+
+			float3 c0 = cross(a1, a2);
+			float3 c1 = cross(a2, a0);
+			float3 c2 = cross(a0, a1);
+
+			float invDet = 1.0f / dot(a0, c0);
+			c0 *= invDet;
+			c1 *= invDet;
+			c2 *= invDet;
+
+			float3 t = c0 * m.x.w + c1 * m.y.w + c2 * m.z.w;
+
+			return float3x4{
+				float4{ c0.x, c1.x, c2.x, -t.x },
+				float4{ c0.y, c1.y, c2.y, -t.y },
+				float4{ c0.z, c1.z, c2.z, -t.z }
+			};
+#endif
+		}
+
+		// batched transforms
+		// positions and normals are structure of arrays, outputs may alias inputs
+
+		namespace detail
+		{
+			template<bool point>
+			inline void transform_soa(const float3x4& m,
+				const float* x, const float* y, const float* z,
+				float* ox, float* oy, float* oz, size_t n)
+			{
+				size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+				{
+					__m256 m00 = _mm256_set1_ps(m.x.x), m01 = _mm256_set1_ps(m.x.y), m02 = _mm256_set1_ps(m.x.z), m03 = _mm256_set1_ps(m.x.w);
+					__m256 m10 = _mm256_set1_ps(m.y.x), m11 = _mm256_set1_ps(m.y.y), m12 = _mm256_set1_ps(m.y.z), m13 = _mm256_set1_ps(m.y.w);
+					__m256 m20 = _mm256_set1_ps(m.z.x), m21 = _mm256_set1_ps(m.z.y), m22 = _mm256_set1_ps(m.z.z), m23 = _mm256_set1_ps(m.z.w);
+
+					for (; i + 8 <= n; i += 8)
+					{
+						__m256 vx = _mm256_loadu_ps(x + i);
+						__m256 vy = _mm256_loadu_ps(y + i);
+						__m256 vz = _mm256_loadu_ps(z + i);
+
+						__m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m00, vx), _mm256_mul_ps(m01, vy)), _mm256_mul_ps(m02, vz));
+						__m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m10, vx), _mm256_mul_ps(m11, vy)), _mm256_mul_ps(m12, vz));
+						__m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m20, vx), _mm256_mul_ps(m21, vy)), _mm256_mul_ps(m22, vz));
+						if (point)
+						{
+							rx = _mm256_add_ps(rx, m03);
+							ry = _mm256_add_ps(ry, m13);
+							rz = _mm256_add_ps(rz, m23);
+						}
+
+						_mm256_storeu_ps(ox + i, rx);
+						_mm256_storeu_ps(oy + i, ry);
+						_mm256_storeu_ps(oz + i, rz);
+					}
+				}
+#endif
+#if defined(TOFU_MATH_SSE2)
+				{
+					__m128 m00 = _mm_set1_ps(m.x.x), m01 = _mm_set1_ps(m.x.y), m02 = _mm_set1_ps(m.x.z), m03 = _mm_set1_ps(m.x.w);
+					__m128 m10 = _mm_set1_ps(m.y.x), m11 = _mm_set1_ps(m.y.y), m12 = _mm_set1_ps(m.y.z), m13 = _mm_set1_ps(m.y.w);
+					__m128 m20 = _mm_set1_ps(m.z.x), m21 = _mm_set1_ps(m.z.y), m22 = _mm_set1_ps(m.z.z), m23 = _mm_set1_ps(m.z.w);
+
+					for (; i + 4 <= n; i += 4)
+					{
+						__m128 vx = _mm_loadu_ps(x + i);
+						__m128 vy = _mm_loadu_ps(y + i);
+						__m128 vz = _mm_loadu_ps(z + i);
+
+						__m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, vx), _mm_mul_ps(m01, vy)), _mm_mul_ps(m02, vz));
+						__m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, vx), _mm_mul_ps(m11, vy)), _mm_mul_ps(m12, vz));
+						__m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, vx), _mm_mul_ps(m21, vy)), _mm_mul_ps(m22, vz));
+						if (point)
+						{
+							rx = _mm_add_ps(rx, m03);
+							ry = _mm_add_ps(ry, m13);
+							rz = _mm_add_ps(rz, m23);
+						}
+
+						_mm_storeu_ps(ox + i, rx);
+						_mm_storeu_ps(oy + i, ry);
+						_mm_storeu_ps(oz + i, rz);
+					}
+				}
+#endif
+				for (; i < n; i++)
+				{
+					float vx = x[i], vy = y[i], vz = z[i];
+					float rx = m.x.x * vx + m.x.y * vy + m.x.z * vz;
+					float ry = m.y.x * vx + m.y.y * vy + m.y.z * vz;
+					float rz = m.z.x * vx + m.z.y * vy + m.z.z * vz;
+					if (point)
+					{
+						rx += m.x.w;
+						ry += m.y.w;
+						rz += m.z.w;
+					}
+					ox[i] = rx;
+					oy[i] = ry;
+					oz[i] = rz;
+				}
+			}
+
+			// gathers float3s at a byte stride, in blocks small enough to stay in L1
+			template<bool point>
+			inline void transform_strided(const float3x4& m, const float3* src, size_t stride,
+				float* ox, float* oy, float* oz, size_t n)
+			{
+				const char* p = reinterpret_cast<const char*>(src);
+				size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+				if (stride % sizeof(float) == 0 && stride * 8 <= INT32_MAX)
+				{
+					__m256i offsets = _mm256_mullo_epi32(
+						_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+						_mm256_set1_epi32(int32_t(stride)));
+
+					for (; i + 8 <= n; i += 8)
+					{
+						const float* base = reinterpret_cast<const float*>(p + i * stride);
+						float bx[8], by[8], bz[8];
+						_mm256_storeu_ps(bx, _mm256_i32gather_ps(base, offsets, 1));
+						_mm256_storeu_ps(by, _mm256_i32gather_ps(base + 1, offsets, 1));
+						_mm256_storeu_ps(bz, _mm256_i32gather_ps(base + 2, offsets, 1));
+						transform_soa<point>(m, bx, by, bz, ox + i, oy + i, oz + i, 8);
+					}
+				}
+#endif
+				const size_t blockSize = 256;
+				float bx[blockSize], by[blockSize], bz[blockSize];
+				while (i < n)
+				{
+					size_t count = n - i < blockSize ? n - i : blockSize;
+					for (size_t j = 0; j < count; j++)
+					{
+						const float3& v = *reinterpret_cast<const float3*>(p + (i + j) * stride);
+						bx[j] = v.x;
+						by[j] = v.y;
+						bz[j] = v.z;
+					}
+					transform_soa<point>(m, bx, by, bz, ox + i, oy + i, oz + i, count);
+					i += count;
+				}
+			}
+
+			template<bool point>
+			inline void transform_indexed(const float3x4* palette, const uint32_t* indices,
+				const float* x, const float* y, const float* z,
+				float* ox, float* oy, float* oz, size_t n)
+			{
+				size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+				{
+					const float* base = &palette[0].x.x;
+					for (; i + 8 <= n; i += 8)
+					{
+						__m256i idx = _mm256_mullo_epi32(
+							_mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + i)),
+							_mm256_set1_epi32(12));
+
+						__m256 vx = _mm256_loadu_ps(x + i);
+						__m256 vy = _mm256_loadu_ps(y + i);
+						__m256 vz = _mm256_loadu_ps(z + i);
+
+						__m256 r[3];
+						for (int32_t row = 0; row < 3; row++)
+						{
+							const float* b = base + row * 4;
+							__m256 c0 = _mm256_i32gather_ps(b, idx, 4);
+							__m256 c1 = _mm256_i32gather_ps(b + 1, idx, 4);
+							__m256 c2 = _mm256_i32gather_ps(b + 2, idx, 4);
+							r[row] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c0, vx), _mm256_mul_ps(c1, vy)), _mm256_mul_ps(c2, vz));
+							if (point)
+							{
+								r[row] = _mm256_add_ps(r[row], _mm256_i32gather_ps(b + 3, idx, 4));
+							}
+						}
+
+						_mm256_storeu_ps(ox + i, r[0]);
+						_mm256_storeu_ps(oy + i, r[1]);
+						_mm256_storeu_ps(oz + i, r[2]);
+					}
+				}
+#endif
+#if defined(TOFU_MATH_SSE2)
+				for (; i + 4 <= n; i += 4)
+				{
+					const float3x4& m0 = palette[indices[i]];
+					const float3x4& m1 = palette[indices[i + 1]];
+					const float3x4& m2 = palette[indices[i + 2]];
+					const float3x4& m3 = palette[indices[i + 3]];
+
+					__m128 vx = _mm_loadu_ps(x + i);
+					__m128 vy = _mm_loadu_ps(y + i);
+					__m128 vz = _mm_loadu_ps(z + i);
+
+					__m128 r[3];
+					for (int32_t row = 0; row < 3; row++)
+					{
+						// one row of each lane's matrix, transposed into coefficient vectors
+						__m128 c0 = load((&m0.x)[row]);
+						__m128 c1 = load((&m1.x)[row]);
+						__m128 c2 = load((&m2.x)[row]);
+						__m128 c3 = load((&m3.x)[row]);
+						_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+						r[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, vx), _mm_mul_ps(c1, vy)), _mm_mul_ps(c2, vz));
+						if (point)
+						{
+							r[row] = _mm_add_ps(r[row], c3);
+						}
+					}
+
+					_mm_storeu_ps(ox + i, r[0]);
+					_mm_storeu_ps(oy + i, r[1]);
+					_mm_storeu_ps(oz + i, r[2]);
+				}
+#endif
+				for (; i < n; i++)
+				{
+					transform_soa<point>(palette[indices[i]], x + i, y + i, z + i, ox + i, oy + i, oz + i, 1);
+				}
+			}
+		}
+
+		// out = m * (p, 1)
+		inline void transformPoints(const float3x4& m,
+			const float* x, const float* y, const float* z,
+			float* ox, float* oy, float* oz, size_t n)
+		{
+			detail::transform_soa<true>(m, x, y, z, ox, oy, oz, n);
+		}
+
+		// out = m * (v, 0)
+		// for normals pass the inverse transpose if m has non-uniform scale
+		inline void transformVectors(const float3x4& m,
+			const float* x, const float* y, const float* z,
+			float* ox, float* oy, float* oz, size_t n)
+		{
+			detail::transform_soa<false>(m, x, y, z, ox, oy, oz, n);
+		}
+
+		// the last row of m is ignored, there is no perspective divide
+		inline void transformPoints(const float4x4& m,
+			const float* x, const float* y, const float* z,
+			float* ox, float* oy, float* oz, size_t n)
+		{
+			detail::transform_soa<true>(toFloat3x4(m), x, y, z, ox, oy, oz, n);
+		}
+
+		inline void transformVectors(const float4x4& m,
+			const float* x, const float* y, const float* z,
+			float* ox, float* oy, float* oz, size_t n)
+		{
+			detail::transform_soa<false>(toFloat3x4(m), x, y, z, ox, oy, oz, n);
+		}
+
+		// gathers input from an array of structures
+		// e.g. transformPoints(m, &vertices[0].position, sizeof(SkinnedVertex), ...)
+		inline void transformPoints(const float3x4& m, const float3* src, size_t stride,
+			float* ox, float* oy, float* oz, size_t n)
+		{
+			detail::transform_strided<true>(m, src, stride, ox, oy, oz, n);
+		}
+
+		inline void transformVectors(const float3x4& m, const float3* src, size_t stride,
+			float* ox, float* oy, float* oz, size_t n)
+		{
+			detail::transform_strided<false>(m, src, stride, ox, oy, oz, n);
+		}
+
+		// element i is transformed by palette[indices[i]]
+		inline void transformPointsIndexed(const float3x4* palette, const uint32_t* indices,
+			const float* x, const float* y, const float* z,
+			float* ox, float* oy, float* oz, size_t n)
+		{
+			detail::transform_indexed<true>(palette, indices, x, y, z, ox, oy, oz, n);
+		}
+
+		inline void transformVectorsIndexed(const float3x4* palette, const uint32_t* indices,
+			const float* x, const float* y, const float* z,
+			float* ox, float* oy, float* oz, size_t n)
+		{
+			detail::transform_indexed<false>(palette, indices, x, y, z, ox, oy, oz, n);
+		}
+
+		// SIMD lanes
+		// the same kernel templates run on __m128 (4 lanes) and __m256 (8 lanes)
+
+#if defined(TOFU_MATH_SSE2)
+		namespace detail
+		{
+			template<typename V> V vset1(float a);
+			template<typename V> V vloadu(const float* p);
+
+			template<> inline __m128 vset1<__m128>(float a) { return _mm_set1_ps(a); }
+			template<> inline __m128 vloadu<__m128>(const float* p) { return _mm_loadu_ps(p); }
+			inline void vstoreu(float* p, __m128 a) { _mm_storeu_ps(p, a); }
+
+			inline __m128 vadd(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+			inline __m128 vsub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+			inline __m128 vmul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+			inline __m128 vdiv(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+			inline __m128 vsqrt(__m128 a) { return _mm_sqrt_ps(a); }
+			inline __m128 vmin(__m128 a, __m128 b) { return _mm_min_ps(a, b); }
+			inline __m128 vmax(__m128 a, __m128 b) { return _mm_max_ps(a, b); }
+			inline __m128 vand(__m128 a, __m128 b) { return _mm_and_ps(a, b); }
+			inline __m128 vandnot(__m128 a, __m128 b) { return _mm_andnot_ps(a, b); }
+			inline __m128 vor(__m128 a, __m128 b) { return _mm_or_ps(a, b); }
+			inline __m128 vxor(__m128 a, __m128 b) { return _mm_xor_ps(a, b); }
+			inline __m128 vcmplt(__m128 a, __m128 b) { return _mm_cmplt_ps(a, b); }
+			inline __m128 vcmpgt(__m128 a, __m128 b) { return _mm_cmpgt_ps(a, b); }
+			inline __m128 vcmpeq(__m128 a, __m128 b) { return _mm_cmpeq_ps(a, b); }
+
+			// in-register 4x4 transpose
+			inline void vtranspose(__m128& a, __m128& b, __m128& c, __m128& d)
+			{
+				_MM_TRANSPOSE4_PS(a, b, c, d);
+			}
+
+			// 4 float4s to x, y, z, w vectors
+			inline void load_soa(const float4* p, __m128& x, __m128& y, __m128& z, __m128& w)
+			{
+				x = load(p[0]);
+				y = load(p[1]);
+				z = load(p[2]);
+				w = load(p[3]);
+				vtranspose(x, y, z, w);
+			}
+
+			inline void store_soa(float4* p, __m128 x, __m128 y, __m128 z, __m128 w)
+			{
+				vtranspose(x, y, z, w);
+				_mm_storeu_ps(&p[0].x, x);
+				_mm_storeu_ps(&p[1].x, y);
+				_mm_storeu_ps(&p[2].x, z);
+				_mm_storeu_ps(&p[3].x, w);
+			}
+
+			// 4 float3x4s to 12 coefficient vectors
+			inline void load_soa(const float3x4* p, __m128* m)
+			{
+				for (uint32_t row = 0; row < 3; row++)
+				{
+					__m128 a = load((&p[0].x)[row]), b = load((&p[1].x)[row]), c = load((&p[2].x)[row]), d = load((&p[3].x)[row]);
+					vtranspose(a, b, c, d);
+					m[row * 4] = a;
+					m[row * 4 + 1] = b;
+					m[row * 4 + 2] = c;
+					m[row * 4 + 3] = d;
+				}
+			}
+
+			// 4 float3x4s from 12 coefficient vectors
+			inline void store_soa(float3x4* p, const __m128* m)
+			{
+				for (uint32_t row = 0; row < 3; row++)
+				{
+					__m128 a = m[row * 4], b = m[row * 4 + 1], c = m[row * 4 + 2], d = m[row * 4 + 3];
+					vtranspose(a, b, c, d);
+					_mm_storeu_ps(&(&p[0].x)[row].x, a);
+					_mm_storeu_ps(&(&p[1].x)[row].x, b);
+					_mm_storeu_ps(&(&p[2].x)[row].x, c);
+					_mm_storeu_ps(&(&p[3].x)[row].x, d);
+				}
+			}
+
+#if defined(TOFU_MATH_AVX2)
+			template<> inline __m256 vset1<__m256>(float a) { return _mm256_set1_ps(a); }
+			template<> inline __m256 vloadu<__m256>(const float* p) { return _mm256_loadu_ps(p); }
+			inline void vstoreu(float* p, __m256 a) { _mm256_storeu_ps(p, a); }
+
+			inline __m256 vadd(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+			inline __m256 vsub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+			inline __m256 vmul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+			inline __m256 vdiv(__m256 a, __m256 b) { return _mm256_div_ps(a, b); }
+			inline __m256 vsqrt(__m256 a) { return _mm256_sqrt_ps(a); }
+			inline __m256 vmin(__m256 a, __m256 b) { return _mm256_min_ps(a, b); }
+			inline __m256 vmax(__m256 a, __m256 b) { return _mm256_max_ps(a, b); }
+			inline __m256 vand(__m256 a, __m256 b) { return _mm256_and_ps(a, b); }
+			inline __m256 vandnot(__m256 a, __m256 b) { return _mm256_andnot_ps(a, b); }
+			inline __m256 vor(__m256 a, __m256 b) { return _mm256_or_ps(a, b); }
+			inline __m256 vxor(__m256 a, __m256 b) { return _mm256_xor_ps(a, b); }
+			inline __m256 vcmplt(__m256 a, __m256 b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+			inline __m256 vcmpgt(__m256 a, __m256 b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+			inline __m256 vcmpeq(__m256 a, __m256 b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+
+			// 4x4 transpose within each 128 bit half
+			inline void vtranspose(__m256& a, __m256& b, __m256& c, __m256& d)
+			{
+				__m256 t0 = _mm256_unpacklo_ps(a, b);
+				__m256 t1 = _mm256_unpacklo_ps(c, d);
+				__m256 t2 = _mm256_unpackhi_ps(a, b);
+				__m256 t3 = _mm256_unpackhi_ps(c, d);
+				a = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+				b = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+				c = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+				d = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+			}
+
+			inline __m256 load_pair(const float4& lo, const float4& hi)
+			{
+				return _mm256_insertf128_ps(_mm256_castps128_ps256(load(lo)), load(hi), 1);
+			}
+
+			inline void store_pair(float4& lo, float4& hi, __m256 a)
+			{
+				_mm_storeu_ps(&lo.x, _mm256_castps256_ps128(a));
+				_mm_storeu_ps(&hi.x, _mm256_extractf128_ps(a, 1));
+			}
+
+			// 8 float4s to x, y, z, w vectors
+			inline void load_soa(const float4* p, __m256& x, __m256& y, __m256& z, __m256& w)
+			{
+				x = load_pair(p[0], p[4]);
+				y = load_pair(p[1], p[5]);
+				z = load_pair(p[2], p[6]);
+				w = load_pair(p[3], p[7]);
+				vtranspose(x, y, z, w);
+			}
+
+			inline void store_soa(float4* p, __m256 x, __m256 y, __m256 z, __m256 w)
+			{
+				vtranspose(x, y, z, w);
+				store_pair(p[0], p[4], x);
+				store_pair(p[1], p[5], y);
+				store_pair(p[2], p[6], z);
+				store_pair(p[3], p[7], w);
+			}
+
+			// 8 float3x4s to 12 coefficient vectors
+			inline void load_soa(const float3x4* p, __m256* m)
+			{
+				for (uint32_t row = 0; row < 3; row++)
+				{
+					__m256 a = load_pair((&p[0].x)[row], (&p[4].x)[row]);
+					__m256 b = load_pair((&p[1].x)[row], (&p[5].x)[row]);
+					__m256 c = load_pair((&p[2].x)[row], (&p[6].x)[row]);
+					__m256 d = load_pair((&p[3].x)[row], (&p[7].x)[row]);
+					vtranspose(a, b, c, d);
+					m[row * 4] = a;
+					m[row * 4 + 1] = b;
+					m[row * 4 + 2] = c;
+					m[row * 4 + 3] = d;
+				}
+			}
+
+			// 8 float3x4s from 12 coefficient vectors
+			inline void store_soa(float3x4* p, const __m256* m)
+			{
+				for (uint32_t row = 0; row < 3; row++)
+				{
+					__m256 a = m[row * 4], b = m[row * 4 + 1], c = m[row * 4 + 2], d = m[row * 4 + 3];
+					vtranspose(a, b, c, d);
+					store_pair((&p[0].x)[row], (&p[4].x)[row], a);
+					store_pair((&p[1].x)[row], (&p[5].x)[row], b);
+					store_pair((&p[2].x)[row], (&p[6].x)[row], c);
+					store_pair((&p[3].x)[row], (&p[7].x)[row], d);
+				}
+			}
+#endif
+
+			template<typename V>
+			inline V vsignbit()
+			{
+				return vset1<V>(-0.0f);
+			}
+
+			template<typename V>
+			inline V vabs(V a)
+			{
+				return vandnot(vsignbit<V>(), a);
+			}
+
+			// mask ? a : b
+			template<typename V>
+			inline V vselect(V mask, V a, V b)
+			{
+				return vor(vand(mask, a), vandnot(mask, b));
+			}
+		}
+#endif
+
+		// batched quaternions
+		// arrays of float4s, 8 or 4 per iteration depending on the SIMD path
+
+#if defined(TOFU_MATH_SSE2)
+		namespace detail
+		{
+			template<typename V>
+			inline void quat_nlerp_soa(const V* a, const V* b, V t, V* r)
+			{
+				V d = vadd(vadd(vadd(vmul(a[0], b[0]), vmul(a[1], b[1])), vmul(a[2], b[2])), vmul(a[3], b[3]));
+				V wa = vsub(vset1<V>(1.0f), t);
+				V wb = vxor(t, vand(d, vsignbit<V>()));
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					r[c] = vadd(vmul(a[c], wa), vmul(b[c], wb));
+				}
+				V len = vsqrt(vadd(vadd(vadd(vmul(r[0], r[0]), vmul(r[1], r[1])), vmul(r[2], r[2])), vmul(r[3], r[3])));
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					r[c] = vdiv(r[c], len);
+				}
+			}
+
+			template<typename V>
+			inline V slerp_correction(V t, V d)
+			{
+				V a = vadd(vset1<V>(3.55645f), vmul(d, vset1<V>(-1.43519f)));
+				a = vadd(vset1<V>(-3.2452f), vmul(d, a));
+				a = vadd(vset1<V>(1.0904f), vmul(d, a));
+				V b = vadd(vset1<V>(-1.06021f), vmul(d, vset1<V>(0.215638f)));
+				b = vadd(vset1<V>(0.848013f), vmul(d, b));
+				V th = vsub(t, vset1<V>(0.5f));
+				V k = vadd(vmul(vmul(a, th), th), b);
+				return vadd(t, vmul(vmul(vmul(t, th), vsub(t, vset1<V>(1.0f))), k));
+			}
+
+			template<typename V>
+			inline void quat_slerp_approx_soa(const V* a, const V* b, V t, V* r)
+			{
+				V d = vadd(vadd(vadd(vmul(a[0], b[0]), vmul(a[1], b[1])), vmul(a[2], b[2])), vmul(a[3], b[3]));
+				quat_nlerp_soa(a, b, slerp_correction(t, vabs(d)), r);
+			}
+
+			template<typename V>
+			inline void quat_mul_soa(const V* a, const V* b, V* r)
+			{
+				r[0] = vsub(vadd(vadd(vmul(a[3], b[0]), vmul(a[0], b[3])), vmul(a[1], b[2])), vmul(a[2], b[1]));
+				r[1] = vadd(vadd(vsub(vmul(a[3], b[1]), vmul(a[0], b[2])), vmul(a[1], b[3])), vmul(a[2], b[0]));
+				r[2] = vadd(vsub(vadd(vmul(a[3], b[2]), vmul(a[0], b[1])), vmul(a[1], b[0])), vmul(a[2], b[3]));
+				r[3] = vsub(vsub(vsub(vmul(a[3], b[3]), vmul(a[0], b[0])), vmul(a[1], b[1])), vmul(a[2], b[2]));
+			}
+
+			// same terms as rotate(const float4&), m holds 12 coefficients row by row
+			template<typename V>
+			inline void quat_to_matrix_soa(const V* q, V* m)
+			{
+				V two = vset1<V>(2.0f);
+				V a_sqr = vmul(q[3], q[3]);
+				V b_sqr = vmul(q[0], q[0]);
+				V c_sqr = vmul(q[1], q[1]);
+				V d_sqr = vmul(q[2], q[2]);
+
+				V a_b_2 = vmul(vmul(q[3], q[0]), two);
+				V a_c_2 = vmul(vmul(q[3], q[1]), two);
+				V a_d_2 = vmul(vmul(q[3], q[2]), two);
+
+				V b_c_2 = vmul(vmul(q[0], q[1]), two);
+				V b_d_2 = vmul(vmul(q[0], q[2]), two);
+
+				V c_d_2 = vmul(vmul(q[1], q[2]), two);
+
+				V zero = vset1<V>(0.0f);
+
+				m[0] = vsub(vsub(vadd(a_sqr, b_sqr), c_sqr), d_sqr);
+				m[1] = vsub(b_c_2, a_d_2);
+				m[2] = vadd(a_c_2, b_d_2);
+				m[3] = zero;
+
+				m[4] = vadd(a_d_2, b_c_2);
+				m[5] = vsub(vadd(vsub(a_sqr, b_sqr), c_sqr), d_sqr);
+				m[6] = vsub(c_d_2, a_b_2);
+				m[7] = zero;
+
+				m[8] = vsub(b_d_2, a_c_2);
+				m[9] = vadd(a_b_2, c_d_2);
+				m[10] = vadd(vsub(vsub(a_sqr, b_sqr), c_sqr), d_sqr);
+				m[11] = zero;
+			}
+
+			template<typename V>
+			inline void nlerp_block(const float4* a, const float4* b, const float* t, float4* out)
+			{
+				V va[4], vb[4], r[4];
+				load_soa(a, va[0], va[1], va[2], va[3]);
+				load_soa(b, vb[0], vb[1], vb[2], vb[3]);
+				quat_nlerp_soa(va, vb, vloadu<V>(t), r);
+				store_soa(out, r[0], r[1], r[2], r[3]);
+			}
+
+			template<typename V>
+			inline void slerp_approx_block(const float4* a, const float4* b, const float* t, float4* out)
+			{
+				V va[4], vb[4], r[4];
+				load_soa(a, va[0], va[1], va[2], va[3]);
+				load_soa(b, vb[0], vb[1], vb[2], vb[3]);
+				quat_slerp_approx_soa(va, vb, vloadu<V>(t), r);
+				store_soa(out, r[0], r[1], r[2], r[3]);
+			}
+
+			template<typename V>
+			inline void quat_mul_block(const float4* a, const float4* b, float4* out)
+			{
+				V va[4], vb[4], r[4];
+				load_soa(a, va[0], va[1], va[2], va[3]);
+				load_soa(b, vb[0], vb[1], vb[2], vb[3]);
+				quat_mul_soa(va, vb, r);
+				store_soa(out, r[0], r[1], r[2], r[3]);
+			}
+
+			template<typename V>
+			inline void rotate_block(const float4* q, float3x4* out)
+			{
+				V vq[4], m[12];
+				load_soa(q, vq[0], vq[1], vq[2], vq[3]);
+				quat_to_matrix_soa(vq, m);
+				store_soa(out, m);
+			}
+		}
+#endif
+
+		inline void nlerp(const float4* a, const float4* b, const float* t, float4* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::nlerp_block<__m256>(a + i, b + i, t + i, out + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::nlerp_block<__m128>(a + i, b + i, t + i, out + i);
+#endif
+			for (; i < n; i++)
+				out[i] = nlerp(a[i], b[i], t[i]);
+		}
+
+		inline void slerpApprox(const float4* a, const float4* b, const float* t, float4* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::slerp_approx_block<__m256>(a + i, b + i, t + i, out + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::slerp_approx_block<__m128>(a + i, b + i, t + i, out + i);
+#endif
+			for (; i < n; i++)
+				out[i] = slerpApprox(a[i], b[i], t[i]);
+		}
+
+		inline void quatMul(const float4* a, const float4* b, float4* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::quat_mul_block<__m256>(a + i, b + i, out + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::quat_mul_block<__m128>(a + i, b + i, out + i);
+#endif
+			for (; i < n; i++)
+				out[i] = quatMul(a[i], b[i]);
+		}
+
+		// rotation matrices without translation, e.g. for a bone palette
+		inline void rotate(const float4* q, float3x4* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::rotate_block<__m256>(q + i, out + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::rotate_block<__m128>(q + i, out + i);
+#endif
+			for (; i < n; i++)
+				out[i] = toFloat3x4(rotate(q[i]));
+		}
+
+		// inverse
+
+		// inverse of a float3x4 whose 3x3 part is a pure rotation
+		inline float3x4 inverseRigid(const float3x4& m)
+		{
+#if defined(TOFU_MATH_SSE2)
+			__m128 r0 = detail::load(m.x);
+			__m128 r1 = detail::load(m.y);
+			__m128 r2 = detail::load(m.z);
+
+			// transposed rotation times the translation, lane j is dot(column j, t)
+			__m128 t = _mm_mul_ps(r0, _mm_shuffle_ps(r0, r0, _MM_SHUFFLE(3, 3, 3, 3)));
+			t = _mm_add_ps(t, _mm_mul_ps(r1, _mm_shuffle_ps(r1, r1, _MM_SHUFFLE(3, 3, 3, 3))));
+			t = _mm_add_ps(t, _mm_mul_ps(r2, _mm_shuffle_ps(r2, r2, _MM_SHUFFLE(3, 3, 3, 3))));
+			__m128 r3 = _mm_sub_ps(_mm_setzero_ps(), t);
+
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			return float3x4{ detail::store(r0), detail::store(r1), detail::store(r2) };
+#else
+			float3 t{
+				m.x.x * m.x.w + m.y.x * m.y.w + m.z.x * m.z.w,
+				m.x.y * m.x.w + m.y.y * m.y.w + m.z.y * m.z.w,
+				m.x.z * m.x.w + m.y.z * m.y.w + m.z.z * m.z.w
+			};
+			return float3x4{
+				float4{ m.x.x, m.y.x, m.z.x, -t.x },
+				float4{ m.x.y, m.y.y, m.z.y, -t.y },
+				float4{ m.x.z, m.y.z, m.z.z, -t.z }
+			};
+#endif
+		}
+
+		inline float4x4 inverseRigid(const float4x4& m)
+		{
+			return toFloat4x4(inverseRigid(toFloat3x4(m)));
+		}
+
+		// the last row of m must be (0, 0, 0, 1)
+		inline float4x4 inverseAffine(const float4x4& m)
+		{
+			return toFloat4x4(inverse(toFloat3x4(m)));
+		}
+
+#if defined(TOFU_MATH_SSE2)
+		namespace detail
+		{
+			// row major 2x2 matrices stored as (m00, m01, m10, m11)
+
+			// a * b
+			inline __m128 mat2_mul(__m128 a, __m128 b)
+			{
+				return _mm_add_ps(
+					_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+					_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+			}
+
+			// adj(a) * b
+			inline __m128 mat2_adj_mul(__m128 a, __m128 b)
+			{
+				return _mm_sub_ps(
+					_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+					_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+			}
+
+			// a * adj(b)
+			inline __m128 mat2_mul_adj(__m128 a, __m128 b)
+			{
+				return _mm_sub_ps(
+					_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+					_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+			}
+		}
+#endif
+
+		// general inverse, m must not be singular
+		inline float4x4 inverse(const float4x4& m)
+		{
+#if defined(TOFU_MATH_SSE2)
+			// block matrix inverse, m = | A B |
+			//                           | C D | with 2x2 blocks
+			__m128 r0 = detail::load(m.x);
+			__m128 r1 = detail::load(m.y);
+			__m128 r2 = detail::load(m.z);
+			__m128 r3 = detail::load(m.w);
+
+			__m128 A = _mm_movelh_ps(r0, r1);
+			__m128 B = _mm_movehl_ps(r1, r0);
+			__m128 C = _mm_movelh_ps(r2, r3);
+			__m128 D = _mm_movehl_ps(r3, r2);
+
+			// (|A|, |B|, |C|, |D|)
+			__m128 detSub = _mm_sub_ps(
+				_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+				_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+			__m128 detA = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(0, 0, 0, 0));
+			__m128 detB = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(1, 1, 1, 1));
+			__m128 detC = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(2, 2, 2, 2));
+			__m128 detD = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(3, 3, 3, 3));
+
+			__m128 D_C = detail::mat2_adj_mul(D, C);
+			__m128 A_B = detail::mat2_adj_mul(A, B);
+
+			// adjugates of the blocks of the inverse
+			__m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), detail::mat2_mul(B, D_C));
+			__m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), detail::mat2_mul(C, A_B));
+			__m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), detail::mat2_mul_adj(D, A_B));
+			__m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), detail::mat2_mul_adj(A, D_C));
+
+			// |M| = |A| |D| + |B| |C| - tr(adj(A) B adj(D) C)
+			__m128 tr = _mm_mul_ps(A_B, _mm_shuffle_ps(D_C, D_C, _MM_SHUFFLE(3, 1, 2, 0)));
+			tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(2, 3, 0, 1)));
+			tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 0, 3, 2)));
+			__m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+
+			__m128 rDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+			X_ = _mm_mul_ps(X_, rDetM);
+			Y_ = _mm_mul_ps(Y_, rDetM);
+			Z_ = _mm_mul_ps(Z_, rDetM);
+			W_ = _mm_mul_ps(W_, rDetM);
+
+			// the adjugate shuffle and the block layout shuffle in one go
+			return float4x4{
+				detail::store(_mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(1, 3, 1, 3))),
+				detail::store(_mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(0, 2, 0, 2))),
+				detail::store(_mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(1, 3, 1, 3))),
+				detail::store(_mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(0, 2, 0, 2)))
+			};
+#else
+			// cofactors from the 2x2 determinants of the top and bottom row pairs
+			float s0 = m.x.x * m.y.y - m.y.x * m.x.y;
+			float s1 = m.x.x * m.y.z - m.y.x * m.x.z;
+			float s2 = m.x.x * m.y.w - m.y.x * m.x.w;
+			float s3 = m.x.y * m.y.z - m.y.y * m.x.z;
+			float s4 = m.x.y * m.y.w - m.y.y * m.x.w;
+			float s5 = m.x.z * m.y.w - m.y.z * m.x.w;
+
+			float c5 = m.z.z * m.w.w - m.w.z * m.z.w;
+			float c4 = m.z.y * m.w.w - m.w.y * m.z.w;
+			float c3 = m.z.y * m.w.z - m.w.y * m.z.z;
+			float c2 = m.z.x * m.w.w - m.w.x * m.z.w;
+			float c1 = m.z.x * m.w.z - m.w.x * m.z.z;
+			float c0 = m.z.x * m.w.y - m.w.x * m.z.y;
+
+			float invDet = 1.0f / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+
+			return float4x4{
+				float4{
+					( m.y.y * c5 - m.y.z * c4 + m.y.w * c3) * invDet,
+					(-m.x.y * c5 + m.x.z * c4 - m.x.w * c3) * invDet,
+					( m.w.y * s5 - m.w.z * s4 + m.w.w * s3) * invDet,
+					(-m.z.y * s5 + m.z.z * s4 - m.z.w * s3) * invDet
+				},
+				float4{
+					(-m.y.x * c5 + m.y.z * c2 - m.y.w * c1) * invDet,
+					( m.x.x * c5 - m.x.z * c2 + m.x.w * c1) * invDet,
+					(-m.w.x * s5 + m.w.z * s2 - m.w.w * s1) * invDet,
+					( m.z.x * s5 - m.z.z * s2 + m.z.w * s1) * invDet
+				},
+				float4{
+					( m.y.x * c4 - m.y.y * c2 + m.y.w * c0) * invDet,
+					(-m.x.x * c4 + m.x.y * c2 - m.x.w * c0) * invDet,
+					( m.w.x * s4 - m.w.y * s2 + m.w.w * s0) * invDet,
+					(-m.z.x * s4 + m.z.y * s2 - m.z.w * s0) * invDet
+				},
+				float4{
+					(-m.y.x * c3 + m.y.y * c1 - m.y.z * c0) * invDet,
+					( m.x.x * c3 - m.x.y * c1 + m.x.z * c0) * invDet,
+					(-m.w.x * s3 + m.w.y * s1 - m.w.z * s0) * invDet,
+					( m.z.x * s3 - m.z.y * s1 + m.z.z * s0) * invDet
+				}
+			};
+#endif
+		}
+
+		// batched inverse
+
+#if defined(TOFU_MATH_SSE2)
+		namespace detail
+		{
+			// same terms as inverse(const float3x4&), one matrix per lane
+			template<typename V>
+			inline void affine_inverse_soa(const V* m, V* r)
+			{
+				V c0x = vsub(vmul(m[5], m[10]), vmul(m[6], m[9]));
+				V c0y = vsub(vmul(m[6], m[8]), vmul(m[4], m[10]));
+				V c0z = vsub(vmul(m[4], m[9]), vmul(m[5], m[8]));
+
+				V c1x = vsub(vmul(m[9], m[2]), vmul(m[10], m[1]));
+				V c1y = vsub(vmul(m[10], m[0]), vmul(m[8], m[2]));
+				V c1z = vsub(vmul(m[8], m[1]), vmul(m[9], m[0]));
+
+				V c2x = vsub(vmul(m[1], m[6]), vmul(m[2], m[5]));
+				V c2y = vsub(vmul(m[2], m[4]), vmul(m[0], m[6]));
+				V c2z = vsub(vmul(m[0], m[5]), vmul(m[1], m[4]));
+
+				V invDet = vdiv(vset1<V>(1.0f), vadd(vadd(vmul(m[0], c0x), vmul(m[1], c0y)), vmul(m[2], c0z)));
+
+				r[0] = vmul(c0x, invDet); r[1] = vmul(c1x, invDet); r[2] = vmul(c2x, invDet);
+				r[4] = vmul(c0y, invDet); r[5] = vmul(c1y, invDet); r[6] = vmul(c2y, invDet);
+				r[8] = vmul(c0z, invDet); r[9] = vmul(c1z, invDet); r[10] = vmul(c2z, invDet);
+
+				V zero = vset1<V>(0.0f);
+				for (uint32_t row = 0; row < 3; row++)
+				{
+					V* o = r + row * 4;
+					o[3] = vsub(zero, vadd(vadd(vmul(o[0], m[3]), vmul(o[1], m[7])), vmul(o[2], m[11])));
+				}
+			}
+
+			template<typename V>
+			inline void rigid_inverse_soa(const V* m, V* r)
+			{
+				r[0] = m[0]; r[1] = m[4]; r[2] = m[8];
+				r[4] = m[1]; r[5] = m[5]; r[6] = m[9];
+				r[8] = m[2]; r[9] = m[6]; r[10] = m[10];
+
+				V zero = vset1<V>(0.0f);
+				for (uint32_t row = 0; row < 3; row++)
+				{
+					V* o = r + row * 4;
+					o[3] = vsub(zero, vadd(vadd(vmul(o[0], m[3]), vmul(o[1], m[7])), vmul(o[2], m[11])));
+				}
+			}
+
+			template<typename V>
+			inline void affine_inverse_block(const float3x4* in, float3x4* out)
+			{
+				V m[12], r[12];
+				load_soa(in, m);
+				affine_inverse_soa(m, r);
+				store_soa(out, r);
+			}
+
+			template<typename V>
+			inline void rigid_inverse_block(const float3x4* in, float3x4* out)
+			{
+				V m[12], r[12];
+				load_soa(in, m);
+				rigid_inverse_soa(m, r);
+				store_soa(out, r);
+			}
+		}
+#endif
+
+		// e.g. inverse bind poses of a whole skeleton, in may alias out
+		inline void inverse(const float3x4* in, float3x4* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::affine_inverse_block<__m256>(in + i, out + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::affine_inverse_block<__m128>(in + i, out + i);
+#endif
+			for (; i < n; i++)
+				out[i] = inverse(in[i]);
+		}
+
+		inline void inverseRigid(const float3x4* in, float3x4* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::rigid_inverse_block<__m256>(in + i, out + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::rigid_inverse_block<__m128>(in + i, out + i);
+#endif
+			for (; i < n; i++)
+				out[i] = inverseRigid(in[i]);
+		}
+
+		inline void inverse(const float4x4* in, float4x4* out, size_t n)
+		{
+			for (size_t i = 0; i < n; i++)
+				out[i] = inverse(in[i]);
+		}
+
+		namespace detail
+		{
+			// bit casts without aliasing violations
+			inline uint32_t as_uint(float f)
+			{
+				uint32_t u;
+				memcpy(&u, &f, sizeof(u));
+				return u;
+			}
+
+			inline float as_float(uint32_t u)
+			{
+				float f;
+				memcpy(&f, &u, sizeof(f));
+				return f;
+			}
+		}
+
+		// fast approximations
+		// hot paths opt in by qualifying calls, e.g. fast::normalize(v), the
+		// unqualified functions stay exact (argument dependent lookup finds
+		// those, so a using directive is not enough)
+		// error bounds are relative unless stated otherwise
+
+		namespace fast
+		{
+			// 1 / sqrt(x), x > 0, relative error below 5e-7 (SSE) or 5e-6 (scalar)
+			inline float rsqrt(float x)
+			{
+#if defined(TOFU_MATH_SSE2)
+				// 12 bit hardware estimate and one Newton step
+				float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+				return y * (1.5f - 0.5f * x * y * y);
+#else
+				// bit level estimate and two Newton steps
+				float y = detail::as_float(0x5f375a86u - (detail::as_uint(x) >> 1));
+				y = y * (1.5f - 0.5f * x * y * y);
+				return y * (1.5f - 0.5f * x * y * y);
+#endif
+			}
+
+			// sine and cosine, absolute error below 1.5e-7 for |x| < 1e4
+			// x is reduced to [-pi/4, pi/4] with a three part pi/2, then minimax polynomials
+			inline void sincos(float x, float& s, float& c)
+			{
+				float k = std::floor(x * 0.636619772f + 0.5f);
+				int32_t quadrant = int32_t(k);
+				float r = x - k * 1.5703125f;
+				r = r - k * 4.837512969970703125e-4f;
+				r = r - k * 7.54978995489188216e-8f;
+				float r2 = r * r;
+
+				float ps = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+				float pc = 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568e-2f + r2 * (-1.388731625e-3f + r2 * 2.443315711e-5f));
+
+				switch (quadrant & 3)
+				{
+				case 0: s = ps; c = pc; break;
+				case 1: s = pc; c = -ps; break;
+				case 2: s = -ps; c = -pc; break;
+				default: s = -pc; c = ps; break;
+				}
+			}
+
+			inline float sin(float x)
+			{
+				float s, c;
+				sincos(x, s, c);
+				return s;
+			}
+
+			inline float cos(float x)
+			{
+				float s, c;
+				sincos(x, s, c);
+				return c;
+			}
+
+			inline float length(const float3& a)
+			{
+				float l2 = dot(a, a);
+				return l2 * rsqrt(l2);
+			}
+
+			// the result has unit length within the error of rsqrt
+			inline float3 normalize(const float3& a)
+			{
+				return a * rsqrt(dot(a, a));
+			}
+
+			// w is ignored, as in math::normalize
+			inline float4 normalize(const float4& a)
+			{
+				return a * rsqrt(dot(a, a));
+			}
+
+			inline float4 quatNormalize(const float4& q)
+			{
+				return q * rsqrt(quatDot(q, q));
+			}
+
+			inline float4 quat(float theta, const float3& axis)
+			{
+				float s, c;
+				sincos(theta * 0.5f, s, c);
+				return float4{ s * axis.x, s * axis.y, s * axis.z, c };
+			}
+
+			inline float4 nlerp(const float4& a, const float4& b, float t)
+			{
+				float wb = quatDot(a, b) < 0.0f ? -t : t;
+				return fast::quatNormalize(a * (1.0f - t) + b * wb);
+			}
+
+			inline float4 slerpApprox(const float4& a, const float4& b, float t)
+			{
+				float d = quatDot(a, b);
+				return fast::nlerp(a, b, detail::slerp_correction(t, std::fabs(d)));
+			}
+		}
+
+		// rotation matrix to quaternion
+
+		namespace detail
+		{
+			// Shepperd's method, picks the largest of 4w^2, 4x^2, 4y^2, 4z^2 to divide by
+			// written with selects so that scalar and SIMD lanes share it
+			template<typename V, typename Ops>
+			inline void quat_from_rotation(const V* m, V* q, const Ops& ops)
+			{
+				V one = ops.set1(1.0f);
+				V t0 = ops.add(ops.add(ops.add(one, m[0]), m[5]), m[10]);
+				V t1 = ops.sub(ops.sub(ops.add(one, m[0]), m[5]), m[10]);
+				V t2 = ops.sub(ops.add(ops.sub(one, m[0]), m[5]), m[10]);
+				V t3 = ops.add(ops.sub(ops.sub(one, m[0]), m[5]), m[10]);
+
+				V isx = ops.cmpgt(t1, t0);
+				V best = ops.max(t0, t1);
+				V isy = ops.cmpgt(t2, best);
+				best = ops.max(best, t2);
+				V isz = ops.cmpgt(t3, best);
+				best = ops.max(best, t3);
+				isy = ops.andnot(isz, isy);
+				isx = ops.andnot(ops.or_(isy, isz), isx);
+
+				V main = ops.mul(ops.set1(0.5f), ops.sqrt(best));
+				V f = ops.div(ops.set1(0.25f), main);
+
+				V a = ops.mul(ops.sub(m[9], m[6]), f);
+				V b = ops.mul(ops.sub(m[2], m[8]), f);
+				V c = ops.mul(ops.sub(m[4], m[1]), f);
+				V d = ops.mul(ops.add(m[1], m[4]), f);
+				V e = ops.mul(ops.add(m[2], m[8]), f);
+				V g = ops.mul(ops.add(m[6], m[9]), f);
+
+				q[0] = ops.select(isx, main, ops.select(isy, d, ops.select(isz, e, a)));
+				q[1] = ops.select(isx, d, ops.select(isy, main, ops.select(isz, g, b)));
+				q[2] = ops.select(isx, e, ops.select(isy, g, ops.select(isz, main, c)));
+				q[3] = ops.select(isx, a, ops.select(isy, b, ops.select(isz, c, main)));
+			}
+
+			struct scalar_ops
+			{
+				float set1(float a) const { return a; }
+				float add(float a, float b) const { return a + b; }
+				float sub(float a, float b) const { return a - b; }
+				float mul(float a, float b) const { return a * b; }
+				float div(float a, float b) const { return a / b; }
+				float sqrt(float a) const { return std::sqrt(a); }
+				float max(float a, float b) const { return a > b ? a : b; }
+				bool cmpgt(float a, float b) const { return a > b; }
+				bool cmpeq(float a, float b) const { return a == b; }
+				bool andnot(bool a, bool b) const { return !a && b; }
+				bool or_(bool a, bool b) const { return a || b; }
+				float select(bool mask, float a, float b) const { return mask ? a : b; }
+			};
+
+#if defined(TOFU_MATH_SSE2)
+			template<typename V>
+			struct simd_ops
+			{
+				V set1(float a) const { return vset1<V>(a); }
+				V add(V a, V b) const { return vadd(a, b); }
+				V sub(V a, V b) const { return vsub(a, b); }
+				V mul(V a, V b) const { return vmul(a, b); }
+				V div(V a, V b) const { return vdiv(a, b); }
+				V sqrt(V a) const { return vsqrt(a); }
+				V max(V a, V b) const { return vmax(a, b); }
+				V cmpgt(V a, V b) const { return vcmpgt(a, b); }
+				V cmpeq(V a, V b) const { return vcmpeq(a, b); }
+				V andnot(V a, V b) const { return vandnot(a, b); }
+				V or_(V a, V b) const { return vor(a, b); }
+				V select(V mask, V a, V b) const { return vselect(mask, a, b); }
+			};
+#endif
+		}
+
+		// the 3x3 part of m must be a pure rotation
+		inline float4 quatFromMatrix(const float3x4& m)
+		{
+			const float* c = &m.x.x;
+			float q[4];
+			detail::quat_from_rotation(c, q, detail::scalar_ops());
+			return float4{ q[0], q[1], q[2], q[3] };
+		}
+
+		// dual quaternion
+
+		inline dualquat toDualQuat(const float4& rotation, const float3& translation)
+		{
+			float4 t{ translation.x, translation.y, translation.z, 0.0f };
+			return dualquat{ rotation, quatMul(t, rotation) * 0.5f };
+		}
+
+		// m must be a rotation and translation only, scale is not representable
+		inline dualquat toDualQuat(const float3x4& m)
+		{
+			return toDualQuat(quatFromMatrix(m), float3{ m.x.w, m.y.w, m.z.w });
+		}
+
+		inline float3 getTranslation(const dualquat& dq)
+		{
+			float4 t = quatMul(dq.dual, conjugate(dq.real)) * 2.0f;
+			return float3{ t.x, t.y, t.z };
+		}
+
+		inline float3x4 toFloat3x4(const dualquat& dq)
+		{
+			float3x4 m = toFloat3x4(rotate(dq.real));
+			float3 t = getTranslation(dq);
+			m.x.w = t.x;
+			m.y.w = t.y;
+			m.z.w = t.z;
+			return m;
+		}
+
+		// unit real part, dual part made orthogonal to it
+		inline dualquat dualquatNormalize(const dualquat& dq)
+		{
+			float inv = 1.0f / std::sqrt(quatDot(dq.real, dq.real));
+			float4 real = dq.real * inv;
+			float4 dual = dq.dual * inv;
+			return dualquat{ real, dual - real * quatDot(real, dual) };
+		}
+
+		inline dualquat dualquatMul(const dualquat& a, const dualquat& b)
+		{
+			return dualquat{
+				quatMul(a.real, b.real),
+				quatMul(a.real, b.dual) + quatMul(a.dual, b.real)
+			};
+		}
+
+		// the real part must have unit length
+		inline float3 transformPoint(const dualquat& dq, const float3& p)
+		{
+			float3 r{ dq.real.x, dq.real.y, dq.real.z };
+			float3 d{ dq.dual.x, dq.dual.y, dq.dual.z };
+			float3 t = (d * dq.real.w - r * dq.dual.w + cross(r, d)) * 2.0f;
+			return quatRotate(dq.real, p) + t;
+		}
+
+		inline float3 transformVector(const dualquat& dq, const float3& v)
+		{
+			return quatRotate(dq.real, v);
+		}
+
+		// dual quaternion linear blending of 4 influences
+		// influences are flipped onto the hemisphere of the first one, the result
+		// is divided by the length of its real part
+		inline dualquat blend(const dualquat* palette, const int4& bones, const float4& weights)
+		{
+			const dualquat& d0 = palette[bones.x];
+			const dualquat& d1 = palette[bones.y];
+			const dualquat& d2 = palette[bones.z];
+			const dualquat& d3 = palette[bones.w];
+
+			float w0 = weights.x;
+			float w1 = quatDot(d0.real, d1.real) < 0.0f ? -weights.y : weights.y;
+			float w2 = quatDot(d0.real, d2.real) < 0.0f ? -weights.z : weights.z;
+			float w3 = quatDot(d0.real, d3.real) < 0.0f ? -weights.w : weights.w;
+
+			float4 real = d0.real * w0 + d1.real * w1 + d2.real * w2 + d3.real * w3;
+			float4 dual = d0.dual * w0 + d1.dual * w1 + d2.dual * w2 + d3.dual * w3;
+
+			float inv = 1.0f / std::sqrt(quatDot(real, real));
+			return dualquat{ real * inv, dual * inv };
+		}
+
+		// batched dual quaternions
+
+#if defined(TOFU_MATH_SSE2)
+		namespace detail
+		{
+			// 4 or 8 float4s from scattered addresses, same lane order as load_soa
+			inline void gather_soa(const float4* const* p, __m128& x, __m128& y, __m128& z, __m128& w)
+			{
+				x = load(*p[0]);
+				y = load(*p[1]);
+				z = load(*p[2]);
+				w = load(*p[3]);
+				vtranspose(x, y, z, w);
+			}
+
+#if defined(TOFU_MATH_AVX2)
+			inline void gather_soa(const float4* const* p, __m256& x, __m256& y, __m256& z, __m256& w)
+			{
+				x = load_pair(*p[0], *p[4]);
+				y = load_pair(*p[1], *p[5]);
+				z = load_pair(*p[2], *p[6]);
+				w = load_pair(*p[3], *p[7]);
+				vtranspose(x, y, z, w);
+			}
+#endif
+
+			template<typename V>
+			inline void dualquat_blend_block(const dualquat* palette, const int4* bones, const float4* weights, dualquat* out)
+			{
+				const uint32_t lanes = sizeof(V) / sizeof(float);
+
+				V w[4];
+				load_soa(weights, w[0], w[1], w[2], w[3]);
+
+				V real[4], dual[4], r0[4];
+				for (uint32_t k = 0; k < 4; k++)
+				{
+					const float4* pr[8];
+					const float4* pd[8];
+					for (uint32_t l = 0; l < lanes; l++)
+					{
+						const dualquat& dq = palette[(&bones[l].x)[k]];
+						pr[l] = &dq.real;
+						pd[l] = &dq.dual;
+					}
+
+					V r[4], d[4];
+					gather_soa(pr, r[0], r[1], r[2], r[3]);
+					gather_soa(pd, d[0], d[1], d[2], d[3]);
+
+					V wk = w[k];
+					if (k == 0)
+					{
+						for (uint32_t c = 0; c < 4; c++)
+							r0[c] = r[c];
+					}
+					else
+					{
+						V dt = vadd(vadd(vadd(vmul(r0[0], r[0]), vmul(r0[1], r[1])), vmul(r0[2], r[2])), vmul(r0[3], r[3]));
+						wk = vxor(wk, vand(dt, vsignbit<V>()));
+					}
+
+					for (uint32_t c = 0; c < 4; c++)
+					{
+						V rc = vmul(r[c], wk);
+						V dc = vmul(d[c], wk);
+						real[c] = k == 0 ? rc : vadd(real[c], rc);
+						dual[c] = k == 0 ? dc : vadd(dual[c], dc);
+					}
+				}
+
+				V len = vsqrt(vadd(vadd(vadd(vmul(real[0], real[0]), vmul(real[1], real[1])), vmul(real[2], real[2])), vmul(real[3], real[3])));
+				V inv = vdiv(vset1<V>(1.0f), len);
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					real[c] = vmul(real[c], inv);
+					dual[c] = vmul(dual[c], inv);
+				}
+
+				float4 tmp[8];
+				store_soa(tmp, real[0], real[1], real[2], real[3]);
+				for (uint32_t l = 0; l < lanes; l++)
+					out[l].real = tmp[l];
+				store_soa(tmp, dual[0], dual[1], dual[2], dual[3]);
+				for (uint32_t l = 0; l < lanes; l++)
+					out[l].dual = tmp[l];
+			}
+
+			template<bool point, typename V>
+			inline void dualquat_transform_block(const dualquat* dq,
+				const float* x, const float* y, const float* z, float* ox, float* oy, float* oz)
+			{
+				const uint32_t lanes = sizeof(V) / sizeof(float);
+
+				const float4* pr[8];
+				const float4* pd[8];
+				for (uint32_t l = 0; l < lanes; l++)
+				{
+					pr[l] = &dq[l].real;
+					pd[l] = &dq[l].dual;
+				}
+
+				V r[4], d[4];
+				gather_soa(pr, r[0], r[1], r[2], r[3]);
+
+				V p[3] = { vloadu<V>(x), vloadu<V>(y), vloadu<V>(z) };
+
+				// p + 2 * cross(r, cross(r, p) + w * p)
+				V two = vset1<V>(2.0f);
+				V c0 = vadd(vsub(vmul(r[1], p[2]), vmul(r[2], p[1])), vmul(r[3], p[0]));
+				V c1 = vadd(vsub(vmul(r[2], p[0]), vmul(r[0], p[2])), vmul(r[3], p[1]));
+				V c2 = vadd(vsub(vmul(r[0], p[1]), vmul(r[1], p[0])), vmul(r[3], p[2]));
+				V o[3] = {
+					vadd(p[0], vmul(two, vsub(vmul(r[1], c2), vmul(r[2], c1)))),
+					vadd(p[1], vmul(two, vsub(vmul(r[2], c0), vmul(r[0], c2)))),
+					vadd(p[2], vmul(two, vsub(vmul(r[0], c1), vmul(r[1], c0))))
+				};
+
+				if (point)
+				{
+					// 2 * (w * d - dw * r + cross(r, d))
+					gather_soa(pd, d[0], d[1], d[2], d[3]);
+					o[0] = vadd(o[0], vmul(two, vadd(vsub(vmul(r[3], d[0]), vmul(d[3], r[0])), vsub(vmul(r[1], d[2]), vmul(r[2], d[1])))));
+					o[1] = vadd(o[1], vmul(two, vadd(vsub(vmul(r[3], d[1]), vmul(d[3], r[1])), vsub(vmul(r[2], d[0]), vmul(r[0], d[2])))));
+					o[2] = vadd(o[2], vmul(two, vadd(vsub(vmul(r[3], d[2]), vmul(d[3], r[2])), vsub(vmul(r[0], d[1]), vmul(r[1], d[0])))));
+				}
+
+				vstoreu(ox, o[0]);
+				vstoreu(oy, o[1]);
+				vstoreu(oz, o[2]);
+			}
+
+			template<typename V>
+			inline void dualquat_from_matrix_block(const float3x4* m, dualquat* out)
+			{
+				V c[12], q[4];
+				load_soa(m, c);
+				quat_from_rotation(c, q, simd_ops<V>());
+
+				// dual = 0.5 * (t, 0) * q
+				V half = vset1<V>(0.5f);
+				V t[3] = { c[3], c[7], c[11] };
+				V d[4] = {
+					vmul(half, vsub(vadd(vmul(t[0], q[3]), vmul(t[1], q[2])), vmul(t[2], q[1]))),
+					vmul(half, vadd(vsub(vmul(t[1], q[3]), vmul(t[0], q[2])), vmul(t[2], q[0]))),
+					vmul(half, vsub(vadd(vmul(t[0], q[1]), vmul(t[2], q[3])), vmul(t[1], q[0]))),
+					vmul(half, vsub(vsub(vsub(vset1<V>(0.0f), vmul(t[0], q[0])), vmul(t[1], q[1])), vmul(t[2], q[2])))
+				};
+
+				const uint32_t lanes = sizeof(V) / sizeof(float);
+				float4 tmp[8];
+				store_soa(tmp, q[0], q[1], q[2], q[3]);
+				for (uint32_t l = 0; l < lanes; l++)
+					out[l].real = tmp[l];
+				store_soa(tmp, d[0], d[1], d[2], d[3]);
+				for (uint32_t l = 0; l < lanes; l++)
+					out[l].dual = tmp[l];
+			}
+		}
+#endif
+
+		// e.g. a skinning palette from bone matrices
+		inline void toDualQuat(const float3x4* m, dualquat* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::dualquat_from_matrix_block<__m256>(m + i, out + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::dualquat_from_matrix_block<__m128>(m + i, out + i);
+#endif
+			for (; i < n; i++)
+				out[i] = toDualQuat(m[i]);
+		}
+
+		// per vertex blend, bones and weights are tightly packed arrays of their
+		// own, not pointers into interleaved vertices, e.g. copied once out of
+		// a SkinnedVertex stream
+		inline void blend(const dualquat* palette, const int4* bones, const float4* weights, dualquat* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::dualquat_blend_block<__m256>(palette, bones + i, weights + i, out + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::dualquat_blend_block<__m128>(palette, bones + i, weights + i, out + i);
+#endif
+			for (; i < n; i++)
+				out[i] = blend(palette, bones[i], weights[i]);
+		}
+
+		// element i is transformed by dq[i], e.g. the output of blend
+		inline void transformPoints(const dualquat* dq,
+			const float* x, const float* y, const float* z,
+			float* ox, float* oy, float* oz, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::dualquat_transform_block<true, __m256>(dq + i, x + i, y + i, z + i, ox + i, oy + i, oz + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::dualquat_transform_block<true, __m128>(dq + i, x + i, y + i, z + i, ox + i, oy + i, oz + i);
+#endif
+			for (; i < n; i++)
+			{
+				float3 r = transformPoint(dq[i], float3{ x[i], y[i], z[i] });
+				ox[i] = r.x;
+				oy[i] = r.y;
+				oz[i] = r.z;
+			}
+		}
+
+		inline void transformVectors(const dualquat* dq,
+			const float* x, const float* y, const float* z,
+			float* ox, float* oy, float* oz, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::dualquat_transform_block<false, __m256>(dq + i, x + i, y + i, z + i, ox + i, oy + i, oz + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::dualquat_transform_block<false, __m128>(dq + i, x + i, y + i, z + i, ox + i, oy + i, oz + i);
+#endif
+			for (; i < n; i++)
+			{
+				float3 r = transformVector(dq[i], float3{ x[i], y[i], z[i] });
+				ox[i] = r.x;
+				oy[i] = r.y;
+				oz[i] = r.z;
+			}
+		}
+
+		// packing
+		// float to integer conversions round to nearest even and clamp to the
+		// normalized range, matching the GPU's DXGI *_SNORM / *_UNORM formats
+
+		namespace detail
+		{
+			inline float clamp(float x, float lo, float hi)
+			{
+				return x < lo ? lo : (x > hi ? hi : x);
+			}
+		}
+
+		// IEEE half, round to nearest even, NaN stays NaN, overflow goes to infinity
+		inline uint16_t floatToHalf(float f)
+		{
+			uint32_t u = detail::as_uint(f);
+			uint32_t sign = u & 0x80000000u;
+			u ^= sign;
+
+			uint32_t o;
+			if (u >= 0x47800000u)
+			{
+				// out of range, infinity or NaN
+				o = u > 0x7f800000u ? 0x7e00u : 0x7c00u;
+			}
+			else if (u < 0x38800000u)
+			{
+				// subnormal or zero, let the FPU round by adding a magic number
+				const uint32_t denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+				o = detail::as_uint(detail::as_float(u) + detail::as_float(denormMagic)) - denormMagic;
+			}
+			else
+			{
+				uint32_t mantOdd = (u >> 13) & 1;
+				u += (uint32_t(15 - 127) << 23) + 0xfffu;
+				u += mantOdd;
+				o = u >> 13;
+			}
+
+			return uint16_t(o | (sign >> 16));
+		}
+
+		inline float halfToFloat(uint16_t h)
+		{
+			const uint32_t shiftedExp = 0x7c00u << 13;
+			uint32_t o = uint32_t(h & 0x7fffu) << 13;
+			uint32_t exp = shiftedExp & o;
+			o += (127 - 15) << 23;
+
+			if (exp == shiftedExp)
+			{
+				// infinity or NaN
+				o += (128 - 16) << 23;
+			}
+			else if (exp == 0)
+			{
+				// subnormal, renormalize through the FPU
+				o += 1 << 23;
+				o = detail::as_uint(detail::as_float(o) - detail::as_float(113 << 23));
+			}
+
+			return detail::as_float(o | (uint32_t(h & 0x8000u) << 16));
+		}
+
+		inline int16_t packSnorm16(float x)
+		{
+			return int16_t(std::lrint(detail::clamp(x, -1.0f, 1.0f) * 32767.0f));
+		}
+
+		inline float unpackSnorm16(int16_t x)
+		{
+			float f = float(x) * (1.0f / 32767.0f);
+			return f < -1.0f ? -1.0f : f;
+		}
+
+		inline uint16_t packUnorm16(float x)
+		{
+			return uint16_t(std::lrint(detail::clamp(x, 0.0f, 1.0f) * 65535.0f));
+		}
+
+		inline float unpackUnorm16(uint16_t x)
+		{
+			return float(x) * (1.0f / 65535.0f);
+		}
+
+		inline uint8_t packUnorm8(float x)
+		{
+			return uint8_t(std::lrint(detail::clamp(x, 0.0f, 1.0f) * 255.0f));
+		}
+
+		inline float unpackUnorm8(uint8_t x)
+		{
+			return float(x) * (1.0f / 255.0f);
+		}
+
+		// R10G10B10A2_UNORM, x in the low bits
+		inline uint32_t packUnorm1010102(const float4& v)
+		{
+			uint32_t x = uint32_t(std::lrint(detail::clamp(v.x, 0.0f, 1.0f) * 1023.0f));
+			uint32_t y = uint32_t(std::lrint(detail::clamp(v.y, 0.0f, 1.0f) * 1023.0f));
+			uint32_t z = uint32_t(std::lrint(detail::clamp(v.z, 0.0f, 1.0f) * 1023.0f));
+			uint32_t w = uint32_t(std::lrint(detail::clamp(v.w, 0.0f, 1.0f) * 3.0f));
+			return x | (y << 10) | (z << 20) | (w << 30);
+		}
+
+		inline float4 unpackUnorm1010102(uint32_t p)
+		{
+			return float4{
+				float(p & 0x3ffu) * (1.0f / 1023.0f),
+				float((p >> 10) & 0x3ffu) * (1.0f / 1023.0f),
+				float((p >> 20) & 0x3ffu) * (1.0f / 1023.0f),
+				float(p >> 30) * (1.0f / 3.0f)
 			};
 		}
+
+		// octahedral normal encoding, n must have unit length, result is in [-1, 1]
+		inline float2 octEncode(const float3& n)
+		{
+			float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+			float2 p{ n.x / l1, n.y / l1 };
+			if (n.z < 0.0f)
+			{
+				// fold the lower hemisphere over the diagonals
+				float2 q{
+					(1.0f - std::fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+					(1.0f - std::fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f)
+				};
+				p = q;
+			}
+			return p;
+		}
+
+		inline float3 octDecode(const float2& p)
+		{
+			float3 n{ p.x, p.y, 1.0f - std::fabs(p.x) - std::fabs(p.y) };
+			float t = n.z < 0.0f ? -n.z : 0.0f;
+			n.x += n.x >= 0.0f ? -t : t;
+			n.y += n.y >= 0.0f ? -t : t;
+			return normalize(n);
+		}
+
+		// two snorm16 in 32 bits, angular error below 0.004 degrees
+		inline uint32_t packOctahedral(const float3& n)
+		{
+			float2 p = octEncode(n);
+			return uint32_t(uint16_t(packSnorm16(p.x))) | (uint32_t(uint16_t(packSnorm16(p.y))) << 16);
+		}
+
+		inline float3 unpackOctahedral(uint32_t p)
+		{
+			return octDecode(float2{ unpackSnorm16(int16_t(p & 0xffffu)), unpackSnorm16(int16_t(p >> 16)) });
+		}
+
+		// batched packing
+
+#if defined(TOFU_MATH_SSE2)
+		namespace detail
+		{
+			inline __m128 clamp(__m128 x, float lo, float hi)
+			{
+				return _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(lo)), _mm_set1_ps(hi));
+			}
+
+			// 4 floats to 4 halves in the low 64 bits, same steps as floatToHalf
+			inline __m128i float_to_half(__m128 f)
+			{
+				const __m128i signMask = _mm_set1_epi32(int32_t(0x80000000u));
+				__m128i u = _mm_castps_si128(f);
+				__m128i sign = _mm_and_si128(u, signMask);
+				u = _mm_xor_si128(u, sign);
+
+				// compares are signed, u has no sign bit so they are safe
+				__m128i isInfNan = _mm_cmpgt_epi32(u, _mm_set1_epi32(0x47800000 - 1));
+				__m128i isNan = _mm_cmpgt_epi32(u, _mm_set1_epi32(0x7f800000));
+				__m128i isSub = _mm_cmplt_epi32(u, _mm_set1_epi32(0x38800000));
+
+				__m128i infNan = _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(isNan, _mm_set1_epi32(0x0200)));
+
+				const int32_t denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+				__m128i sub = _mm_sub_epi32(
+					_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(u), _mm_castsi128_ps(_mm_set1_epi32(denormMagic)))),
+					_mm_set1_epi32(denormMagic));
+
+				__m128i mantOdd = _mm_and_si128(_mm_srli_epi32(u, 13), _mm_set1_epi32(1));
+				__m128i norm = _mm_add_epi32(u, _mm_set1_epi32(int32_t(uint32_t(15 - 127) << 23) + 0xfff));
+				norm = _mm_srli_epi32(_mm_add_epi32(norm, mantOdd), 13);
+
+				__m128i o = _mm_or_si128(_mm_and_si128(isSub, sub), _mm_andnot_si128(isSub, norm));
+				o = _mm_or_si128(_mm_and_si128(isInfNan, infNan), _mm_andnot_si128(isInfNan, o));
+				o = _mm_or_si128(o, _mm_srli_epi32(sign, 16));
+
+				// pack the low 16 bits of each lane, values are below 0x10000
+				o = _mm_sub_epi32(o, _mm_set1_epi32(0x8000));
+				o = _mm_packs_epi32(o, o);
+				return _mm_xor_si128(o, _mm_set1_epi16(int16_t(0x8000)));
+			}
+
+			// 4 halves in the low 64 bits to 4 floats, same steps as halfToFloat
+			inline __m128 half_to_float(__m128i h)
+			{
+				h = _mm_unpacklo_epi16(h, _mm_setzero_si128());
+				const __m128i shiftedExp = _mm_set1_epi32(0x7c00 << 13);
+				__m128i o = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+				__m128i exp = _mm_and_si128(o, shiftedExp);
+				o = _mm_add_epi32(o, _mm_set1_epi32((127 - 15) << 23));
+
+				__m128i isInfNan = _mm_cmpeq_epi32(exp, shiftedExp);
+				__m128i isSub = _mm_cmpeq_epi32(exp, _mm_setzero_si128());
+
+				o = _mm_add_epi32(o, _mm_and_si128(isInfNan, _mm_set1_epi32((128 - 16) << 23)));
+
+				__m128 subF = _mm_sub_ps(
+					_mm_castsi128_ps(_mm_add_epi32(o, _mm_set1_epi32(1 << 23))),
+					_mm_castsi128_ps(_mm_set1_epi32(113 << 23)));
+				o = _mm_or_si128(_mm_and_si128(isSub, _mm_castps_si128(subF)), _mm_andnot_si128(isSub, o));
+
+				o = _mm_or_si128(o, _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16));
+				return _mm_castsi128_ps(o);
+			}
+
+			// 4 normals to 4 packed snorm16 pairs
+			inline __m128i oct_encode(__m128 x, __m128 y, __m128 z)
+			{
+				__m128 sign = vsignbit<__m128>();
+				__m128 l1 = _mm_add_ps(_mm_add_ps(vabs(x), vabs(y)), vabs(z));
+				__m128 px = _mm_div_ps(x, l1);
+				__m128 py = _mm_div_ps(y, l1);
+
+				// (1 - |p.yx|) with the sign of p.xy, where +0 counts as positive
+				__m128 one = _mm_set1_ps(1.0f);
+				__m128 signX = _mm_and_ps(_mm_cmplt_ps(px, _mm_setzero_ps()), sign);
+				__m128 signY = _mm_and_ps(_mm_cmplt_ps(py, _mm_setzero_ps()), sign);
+				__m128 fx = _mm_or_ps(_mm_sub_ps(one, vabs(py)), signX);
+				__m128 fy = _mm_or_ps(_mm_sub_ps(one, vabs(px)), signY);
+
+				__m128 lower = _mm_cmplt_ps(z, _mm_setzero_ps());
+				px = vselect(lower, fx, px);
+				py = vselect(lower, fy, py);
+
+				__m128 scale = _mm_set1_ps(32767.0f);
+				__m128i ix = _mm_cvtps_epi32(_mm_mul_ps(clamp(px, -1.0f, 1.0f), scale));
+				__m128i iy = _mm_cvtps_epi32(_mm_mul_ps(clamp(py, -1.0f, 1.0f), scale));
+				return _mm_unpacklo_epi16(_mm_packs_epi32(ix, ix), _mm_packs_epi32(iy, iy));
+			}
+
+			inline void oct_decode(__m128i p, __m128& x, __m128& y, __m128& z)
+			{
+				__m128 scale = _mm_set1_ps(1.0f / 32767.0f);
+				__m128 minusOne = _mm_set1_ps(-1.0f);
+				x = _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(p, 16), 16)), scale), minusOne);
+				y = _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(p, 16)), scale), minusOne);
+				z = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1.0f), vabs(x)), vabs(y));
+
+				__m128 t = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), z), _mm_setzero_ps());
+				__m128 negX = _mm_cmplt_ps(x, _mm_setzero_ps());
+				__m128 negY = _mm_cmplt_ps(y, _mm_setzero_ps());
+				x = _mm_add_ps(x, vselect(negX, t, _mm_sub_ps(_mm_setzero_ps(), t)));
+				y = _mm_add_ps(y, vselect(negY, t, _mm_sub_ps(_mm_setzero_ps(), t)));
+
+				__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+				x = _mm_div_ps(x, len);
+				y = _mm_div_ps(y, len);
+				z = _mm_div_ps(z, len);
+			}
+		}
+#endif
+
+		inline void floatToHalf(const float* in, uint16_t* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_F16C)
+			for (; i + 8 <= n; i += 8)
+			{
+				__m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), h);
+			}
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+			{
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), detail::float_to_half(_mm_loadu_ps(in + i)));
+			}
+#endif
+			for (; i < n; i++)
+				out[i] = floatToHalf(in[i]);
+		}
+
+		inline void halfToFloat(const uint16_t* in, float* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_F16C)
+			for (; i + 8 <= n; i += 8)
+			{
+				__m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				_mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+			}
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+			{
+				_mm_storeu_ps(out + i, detail::half_to_float(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i))));
+			}
+#endif
+			for (; i < n; i++)
+				out[i] = halfToFloat(in[i]);
+		}
+
+		inline void packSnorm16(const float* in, int16_t* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_SSE2)
+			__m128 scale = _mm_set1_ps(32767.0f);
+			for (; i + 8 <= n; i += 8)
+			{
+				__m128i a = _mm_cvtps_epi32(_mm_mul_ps(detail::clamp(_mm_loadu_ps(in + i), -1.0f, 1.0f), scale));
+				__m128i b = _mm_cvtps_epi32(_mm_mul_ps(detail::clamp(_mm_loadu_ps(in + i + 4), -1.0f, 1.0f), scale));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(a, b));
+			}
+#endif
+			for (; i < n; i++)
+				out[i] = packSnorm16(in[i]);
+		}
+
+		inline void unpackSnorm16(const int16_t* in, float* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_SSE2)
+			__m128 scale = _mm_set1_ps(1.0f / 32767.0f);
+			__m128 minusOne = _mm_set1_ps(-1.0f);
+			for (; i + 8 <= n; i += 8)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				// sign extend through the high half of each lane
+				__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+				__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+				_mm_storeu_ps(out + i, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), scale), minusOne));
+				_mm_storeu_ps(out + i + 4, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), scale), minusOne));
+			}
+#endif
+			for (; i < n; i++)
+				out[i] = unpackSnorm16(in[i]);
+		}
+
+		inline void packUnorm16(const float* in, uint16_t* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_SSE2)
+			// SSE2 only has a signed saturating pack, bias into the signed range and back
+			__m128 scale = _mm_set1_ps(65535.0f);
+			__m128i bias = _mm_set1_epi32(32768);
+			for (; i + 8 <= n; i += 8)
+			{
+				__m128i a = _mm_sub_epi32(_mm_cvtps_epi32(_mm_mul_ps(detail::clamp(_mm_loadu_ps(in + i), 0.0f, 1.0f), scale)), bias);
+				__m128i b = _mm_sub_epi32(_mm_cvtps_epi32(_mm_mul_ps(detail::clamp(_mm_loadu_ps(in + i + 4), 0.0f, 1.0f), scale)), bias);
+				__m128i r = _mm_xor_si128(_mm_packs_epi32(a, b), _mm_set1_epi16(int16_t(0x8000)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), r);
+			}
+#endif
+			for (; i < n; i++)
+				out[i] = packUnorm16(in[i]);
+		}
+
+		inline void unpackUnorm16(const uint16_t* in, float* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_SSE2)
+			__m128 scale = _mm_set1_ps(1.0f / 65535.0f);
+			for (; i + 8 <= n; i += 8)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				__m128i lo = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+				__m128i hi = _mm_unpackhi_epi16(v, _mm_setzero_si128());
+				_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+				_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+			}
+#endif
+			for (; i < n; i++)
+				out[i] = unpackUnorm16(in[i]);
+		}
+
+		inline void packUnorm8(const float* in, uint8_t* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_SSE2)
+			__m128 scale = _mm_set1_ps(255.0f);
+			for (; i + 16 <= n; i += 16)
+			{
+				__m128i a = _mm_cvtps_epi32(_mm_mul_ps(detail::clamp(_mm_loadu_ps(in + i), 0.0f, 1.0f), scale));
+				__m128i b = _mm_cvtps_epi32(_mm_mul_ps(detail::clamp(_mm_loadu_ps(in + i + 4), 0.0f, 1.0f), scale));
+				__m128i c = _mm_cvtps_epi32(_mm_mul_ps(detail::clamp(_mm_loadu_ps(in + i + 8), 0.0f, 1.0f), scale));
+				__m128i d = _mm_cvtps_epi32(_mm_mul_ps(detail::clamp(_mm_loadu_ps(in + i + 12), 0.0f, 1.0f), scale));
+				__m128i r = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), r);
+			}
+#endif
+			for (; i < n; i++)
+				out[i] = packUnorm8(in[i]);
+		}
+
+		inline void unpackUnorm8(const uint8_t* in, float* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_SSE2)
+			__m128 scale = _mm_set1_ps(1.0f / 255.0f);
+			__m128i zero = _mm_setzero_si128();
+			for (; i + 16 <= n; i += 16)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				__m128i lo = _mm_unpacklo_epi8(v, zero);
+				__m128i hi = _mm_unpackhi_epi8(v, zero);
+				_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+				_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+				_mm_storeu_ps(out + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+				_mm_storeu_ps(out + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+			}
+#endif
+			for (; i < n; i++)
+				out[i] = unpackUnorm8(in[i]);
+		}
+
+		inline void packUnorm1010102(const float4* in, uint32_t* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_SSE2)
+			__m128 scaleXYZ = _mm_set1_ps(1023.0f);
+			__m128 scaleW = _mm_set1_ps(3.0f);
+			for (; i + 4 <= n; i += 4)
+			{
+				__m128 x, y, z, w;
+				detail::load_soa(in + i, x, y, z, w);
+				__m128i ix = _mm_cvtps_epi32(_mm_mul_ps(detail::clamp(x, 0.0f, 1.0f), scaleXYZ));
+				__m128i iy = _mm_cvtps_epi32(_mm_mul_ps(detail::clamp(y, 0.0f, 1.0f), scaleXYZ));
+				__m128i iz = _mm_cvtps_epi32(_mm_mul_ps(detail::clamp(z, 0.0f, 1.0f), scaleXYZ));
+				__m128i iw = _mm_cvtps_epi32(_mm_mul_ps(detail::clamp(w, 0.0f, 1.0f), scaleW));
+				__m128i r = _mm_or_si128(_mm_or_si128(ix, _mm_slli_epi32(iy, 10)), _mm_or_si128(_mm_slli_epi32(iz, 20), _mm_slli_epi32(iw, 30)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), r);
+			}
+#endif
+			for (; i < n; i++)
+				out[i] = packUnorm1010102(in[i]);
+		}
+
+		inline void unpackUnorm1010102(const uint32_t* in, float4* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_SSE2)
+			__m128 scaleXYZ = _mm_set1_ps(1.0f / 1023.0f);
+			__m128 scaleW = _mm_set1_ps(1.0f / 3.0f);
+			__m128i mask = _mm_set1_epi32(0x3ff);
+			for (; i + 4 <= n; i += 4)
+			{
+				__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				__m128 x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(p, mask)), scaleXYZ);
+				__m128 y = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 10), mask)), scaleXYZ);
+				__m128 z = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 20), mask)), scaleXYZ);
+				__m128 w = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(p, 30)), scaleW);
+				detail::store_soa(out + i, x, y, z, w);
+			}
+#endif
+			for (; i < n; i++)
+				out[i] = unpackUnorm1010102(in[i]);
+		}
+
+		// unit normals to packed snorm16 pairs, see packOctahedral
+		inline void packOctahedral(const float* x, const float* y, const float* z, uint32_t* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+			{
+				__m128i p = detail::oct_encode(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i), _mm_loadu_ps(z + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), p);
+			}
+#endif
+			for (; i < n; i++)
+				out[i] = packOctahedral(float3{ x[i], y[i], z[i] });
+		}
+
+		inline void unpackOctahedral(const uint32_t* in, float* x, float* y, float* z, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+			{
+				__m128 vx, vy, vz;
+				detail::oct_decode(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), vx, vy, vz);
+				_mm_storeu_ps(x + i, vx);
+				_mm_storeu_ps(y + i, vy);
+				_mm_storeu_ps(z + i, vz);
+			}
+#endif
+			for (; i < n; i++)
+			{
+				float3 v = unpackOctahedral(in[i]);
+				x[i] = v.x;
+				y[i] = v.y;
+				z[i] = v.z;
+			}
+		}
+
+		// bounding volumes
+
+		inline aabb aabbFromPoints(const float3* p, size_t n)
+		{
+			if (n == 0)
+				return aabb{ float3{ 0.0f, 0.0f, 0.0f }, float3{ 0.0f, 0.0f, 0.0f } };
+
+			aabb b{ p[0], p[0] };
+			for (size_t i = 1; i < n; i++)
+			{
+				b.min.x = p[i].x < b.min.x ? p[i].x : b.min.x;
+				b.min.y = p[i].y < b.min.y ? p[i].y : b.min.y;
+				b.min.z = p[i].z < b.min.z ? p[i].z : b.min.z;
+				b.max.x = p[i].x > b.max.x ? p[i].x : b.max.x;
+				b.max.y = p[i].y > b.max.y ? p[i].y : b.max.y;
+				b.max.z = p[i].z > b.max.z ? p[i].z : b.max.z;
+			}
+			return b;
+		}
+
+		// bounds of the transformed box, not of the transformed contents
+		inline aabb transformAabb(const float3x4& m, const aabb& b)
+		{
+			float3 c = (b.min + b.max) * 0.5f;
+			float3 e = (b.max - b.min) * 0.5f;
+			float3 tc = transformPoint(m, c);
+			float3 te{
+				std::fabs(m.x.x) * e.x + std::fabs(m.x.y) * e.y + std::fabs(m.x.z) * e.z,
+				std::fabs(m.y.x) * e.x + std::fabs(m.y.y) * e.y + std::fabs(m.y.z) * e.z,
+				std::fabs(m.z.x) * e.x + std::fabs(m.z.y) * e.y + std::fabs(m.z.z) * e.z
+			};
+			return aabb{ tc - te, tc + te };
+		}
+
+		inline aabb transformAabb(const float4x4& m, const aabb& b)
+		{
+			return transformAabb(toFloat3x4(m), b);
+		}
+
+		inline plane normalizePlane(const plane& p)
+		{
+			float s = 1.0f / length(p.normal);
+			return plane{ p.normal * s, p.d * s };
+		}
+
+		inline float distance(const plane& p, const float3& v)
+		{
+			return dot(p.normal, v) + p.d;
+		}
+
+		// planes of a projection * view matrix, world space when given proj * view,
+		// assumes D3D clip space with 0 <= z <= w
+		inline frustum frustumFromMatrix(const float4x4& m)
+		{
+			const float4& r0 = m.x;
+			const float4& r1 = m.y;
+			const float4& r2 = m.z;
+			const float4& r3 = m.w;
+
+			float4 p[6] = { r3 + r0, r3 - r0, r3 + r1, r3 - r1, r2, r3 - r2 };
+
+			frustum f;
+			for (int32_t i = 0; i < 6; i++)
+				f.planes[i] = normalizePlane(plane{ float3{ p[i].x, p[i].y, p[i].z }, p[i].w });
+			return f;
+		}
+
+		inline Containment classify(const frustum& f, const aabb& b)
+		{
+			float3 c = (b.min + b.max) * 0.5f;
+			float3 e = (b.max - b.min) * 0.5f;
+			Containment result = Inside;
+			for (int32_t i = 0; i < 6; i++)
+			{
+				const plane& p = f.planes[i];
+				float d = distance(p, c);
+				float r = std::fabs(p.normal.x) * e.x + std::fabs(p.normal.y) * e.y + std::fabs(p.normal.z) * e.z;
+				if (d < -r)
+					return Outside;
+				if (d < r)
+					result = Intersecting;
+			}
+			return result;
+		}
+
+		inline Containment classify(const frustum& f, const sphere& s)
+		{
+			Containment result = Inside;
+			for (int32_t i = 0; i < 6; i++)
+			{
+				float d = distance(f.planes[i], s.center);
+				if (d < -s.radius)
+					return Outside;
+				if (d < s.radius)
+					result = Intersecting;
+			}
+			return result;
+		}
+
+		// batched culling, one Containment per volume
+
+#if defined(TOFU_MATH_SSE2)
+		namespace detail
+		{
+			inline int32_t vmovemask(__m128 a) { return _mm_movemask_ps(a); }
+
+			// 4 aabbs to min and max vectors, two overlapping loads per box so
+			// the last one never reads past the end of the array
+			inline void load_soa(const aabb* p, __m128* minV, __m128* maxV)
+			{
+				__m128 a = _mm_loadu_ps(&p[0].min.x);
+				__m128 b = _mm_loadu_ps(&p[1].min.x);
+				__m128 c = _mm_loadu_ps(&p[2].min.x);
+				__m128 d = _mm_loadu_ps(&p[3].min.x);
+				vtranspose(a, b, c, d);
+				minV[0] = a;
+				minV[1] = b;
+
+				a = _mm_loadu_ps(&p[0].min.z);
+				b = _mm_loadu_ps(&p[1].min.z);
+				c = _mm_loadu_ps(&p[2].min.z);
+				d = _mm_loadu_ps(&p[3].min.z);
+				vtranspose(a, b, c, d);
+				minV[2] = a;
+				maxV[0] = b;
+				maxV[1] = c;
+				maxV[2] = d;
+			}
+
+#if defined(TOFU_MATH_AVX2)
+			inline int32_t vmovemask(__m256 a) { return _mm256_movemask_ps(a); }
+
+			inline __m256 load_pair(const float* lo, const float* hi)
+			{
+				return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lo)), _mm_loadu_ps(hi), 1);
+			}
+
+			// 8 aabbs to min and max vectors
+			inline void load_soa(const aabb* p, __m256* minV, __m256* maxV)
+			{
+				__m256 a = load_pair(&p[0].min.x, &p[4].min.x);
+				__m256 b = load_pair(&p[1].min.x, &p[5].min.x);
+				__m256 c = load_pair(&p[2].min.x, &p[6].min.x);
+				__m256 d = load_pair(&p[3].min.x, &p[7].min.x);
+				vtranspose(a, b, c, d);
+				minV[0] = a;
+				minV[1] = b;
+
+				a = load_pair(&p[0].min.z, &p[4].min.z);
+				b = load_pair(&p[1].min.z, &p[5].min.z);
+				c = load_pair(&p[2].min.z, &p[6].min.z);
+				d = load_pair(&p[3].min.z, &p[7].min.z);
+				vtranspose(a, b, c, d);
+				minV[2] = a;
+				maxV[0] = b;
+				maxV[1] = c;
+				maxV[2] = d;
+			}
+#endif
+
+			// center c, radius r per lane, r is the projected box extent for
+			// aabbs and the plain radius for spheres (boxExtent == false)
+			template<typename V, bool boxExtent>
+			inline void classify_lanes(const frustum& f, const V* c, const V* e, uint8_t* out)
+			{
+				V zero = vset1<V>(0.0f);
+				V outside = zero;
+				V intersecting = zero;
+				for (int32_t i = 0; i < 6; i++)
+				{
+					const plane& p = f.planes[i];
+					V d = vadd(vadd(vadd(vmul(c[0], vset1<V>(p.normal.x)), vmul(c[1], vset1<V>(p.normal.y))),
+						vmul(c[2], vset1<V>(p.normal.z))), vset1<V>(p.d));
+					V r = e[0];
+					if (boxExtent)
+					{
+						r = vadd(vadd(vmul(e[0], vset1<V>(std::fabs(p.normal.x))), vmul(e[1], vset1<V>(std::fabs(p.normal.y)))),
+							vmul(e[2], vset1<V>(std::fabs(p.normal.z))));
+					}
+					outside = vor(outside, vcmplt(vadd(d, r), zero));
+					intersecting = vor(intersecting, vcmplt(d, r));
+				}
+
+				int32_t outsideBits = vmovemask(outside);
+				int32_t intersectingBits = vmovemask(intersecting);
+				for (size_t k = 0; k < sizeof(V) / sizeof(float); k++)
+				{
+					out[k] = uint8_t((outsideBits >> k) & 1 ? Outside : ((intersectingBits >> k) & 1 ? Intersecting : Inside));
+				}
+			}
+
+			template<typename V>
+			inline void classify_aabbs(const frustum& f, const aabb* b, uint8_t* out)
+			{
+				V minV[3], maxV[3], c[3], e[3];
+				load_soa(b, minV, maxV);
+				V half = vset1<V>(0.5f);
+				for (int32_t i = 0; i < 3; i++)
+				{
+					c[i] = vmul(vadd(minV[i], maxV[i]), half);
+					e[i] = vmul(vsub(maxV[i], minV[i]), half);
+				}
+				classify_lanes<V, true>(f, c, e, out);
+			}
+
+			template<typename V>
+			inline void classify_spheres(const frustum& f, const sphere* s, uint8_t* out)
+			{
+				V c[3], r;
+				load_soa(reinterpret_cast<const float4*>(s), c[0], c[1], c[2], r);
+				classify_lanes<V, false>(f, c, &r, out);
+			}
+		}
+#endif
+
+		inline void classify(const frustum& f, const aabb* boxes, uint8_t* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::classify_aabbs<__m256>(f, boxes + i, out + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::classify_aabbs<__m128>(f, boxes + i, out + i);
+#endif
+			for (; i < n; i++)
+				out[i] = uint8_t(classify(f, boxes[i]));
+		}
+
+		inline void classify(const frustum& f, const sphere* spheres, uint8_t* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::classify_spheres<__m256>(f, spheres + i, out + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::classify_spheres<__m128>(f, spheres + i, out + i);
+#endif
+			for (; i < n; i++)
+				out[i] = uint8_t(classify(f, spheres[i]));
+		}
+
+		// translation, rotation, scale
+
+		namespace detail
+		{
+			// m = T * R * S, the columns of the 3x3 part are the scaled axes of R.
+			// a mirrored basis goes into a negative x scale, a zero scale axis is
+			// left unnormalized and the quaternion renormalized, so degenerate and
+			// slightly sheared matrices still give a unit rotation
+			template<typename V, typename Ops>
+			inline void decompose_affine(const V* m, V* t, V* r, V* s, const Ops& ops)
+			{
+				V zero = ops.set1(0.0f);
+				V one = ops.set1(1.0f);
+
+				t[0] = m[3];
+				t[1] = m[7];
+				t[2] = m[11];
+
+				for (int32_t j = 0; j < 3; j++)
+					s[j] = ops.sqrt(ops.add(ops.add(ops.mul(m[j], m[j]), ops.mul(m[4 + j], m[4 + j])), ops.mul(m[8 + j], m[8 + j])));
+
+				// dot(column 0, cross(column 1, column 2))
+				V det = ops.add(ops.add(
+					ops.mul(m[0], ops.sub(ops.mul(m[5], m[10]), ops.mul(m[9], m[6]))),
+					ops.mul(m[4], ops.sub(ops.mul(m[9], m[2]), ops.mul(m[1], m[10])))),
+					ops.mul(m[8], ops.sub(ops.mul(m[1], m[6]), ops.mul(m[5], m[2]))));
+				s[0] = ops.select(ops.cmpgt(zero, det), ops.sub(zero, s[0]), s[0]);
+
+				V rot[12];
+				for (int32_t j = 0; j < 3; j++)
+				{
+					V d = ops.select(ops.cmpeq(s[j], zero), one, s[j]);
+					rot[j] = ops.div(m[j], d);
+					rot[4 + j] = ops.div(m[4 + j], d);
+					rot[8 + j] = ops.div(m[8 + j], d);
+				}
+				rot[3] = rot[7] = rot[11] = zero;
+
+				// rebuild a collapsed axis from the other two
+				for (int32_t j = 0; j < 3; j++)
+				{
+					int32_t a = (j + 1) % 3;
+					int32_t b = (j + 2) % 3;
+					V degenerate = ops.cmpeq(s[j], zero);
+					rot[j] = ops.select(degenerate, ops.sub(ops.mul(rot[4 + a], rot[8 + b]), ops.mul(rot[8 + a], rot[4 + b])), rot[j]);
+					rot[4 + j] = ops.select(degenerate, ops.sub(ops.mul(rot[8 + a], rot[b]), ops.mul(rot[a], rot[8 + b])), rot[4 + j]);
+					rot[8 + j] = ops.select(degenerate, ops.sub(ops.mul(rot[a], rot[4 + b]), ops.mul(rot[4 + a], rot[b])), rot[8 + j]);
+				}
+
+				quat_from_rotation(rot, r, ops);
+
+				V l = ops.sqrt(ops.add(ops.add(ops.add(ops.mul(r[0], r[0]), ops.mul(r[1], r[1])), ops.mul(r[2], r[2])), ops.mul(r[3], r[3])));
+				for (int32_t j = 0; j < 4; j++)
+					r[j] = ops.div(r[j], l);
+			}
+		}
+
+		inline void decompose(const float3x4& m, float3& translation, float4& rotation, float3& scale)
+		{
+			float t[3], r[4], s[3];
+			detail::decompose_affine(&m.x.x, t, r, s, detail::scalar_ops());
+			translation = float3{ t[0], t[1], t[2] };
+			rotation = float4{ r[0], r[1], r[2], r[3] };
+			scale = float3{ s[0], s[1], s[2] };
+		}
+
+		inline void decompose(const float4x4& m, float3& translation, float4& rotation, float3& scale)
+		{
+			decompose(toFloat3x4(m), translation, rotation, scale);
+		}
+
+		// T * R * S, same terms as rotate(const float4&)
+		inline float3x4 compose(const float3& translation, const float4& rotation, const float3& scale)
+		{
+			float3x4 m = toFloat3x4(rotate(rotation));
+			m.x = float4{ m.x.x * scale.x, m.x.y * scale.y, m.x.z * scale.z, translation.x };
+			m.y = float4{ m.y.x * scale.x, m.y.y * scale.y, m.y.z * scale.z, translation.y };
+			m.z = float4{ m.z.x * scale.x, m.z.y * scale.y, m.z.z * scale.z, translation.z };
+			return m;
+		}
+
+#if defined(TOFU_MATH_SSE2)
+		namespace detail
+		{
+			template<typename V>
+			inline void decompose_block(const float3x4* m, float3* translation, float4* rotation, float3* scale)
+			{
+				const uint32_t lanes = sizeof(V) / sizeof(float);
+				V c[12], t[3], r[4], s[3];
+				load_soa(m, c);
+				decompose_affine(c, t, r, s, simd_ops<V>());
+				store_soa(rotation, r[0], r[1], r[2], r[3]);
+
+				float tmp[6][8];
+				for (int32_t j = 0; j < 3; j++)
+				{
+					vstoreu(tmp[j], t[j]);
+					vstoreu(tmp[3 + j], s[j]);
+				}
+				for (uint32_t l = 0; l < lanes; l++)
+				{
+					translation[l] = float3{ tmp[0][l], tmp[1][l], tmp[2][l] };
+					scale[l] = float3{ tmp[3][l], tmp[4][l], tmp[5][l] };
+				}
+			}
+
+			template<typename V>
+			inline void compose_block(const float3* translation, const float4* rotation, const float3* scale, float3x4* out)
+			{
+				const uint32_t lanes = sizeof(V) / sizeof(float);
+				float tmp[6][8];
+				for (uint32_t l = 0; l < lanes; l++)
+				{
+					tmp[0][l] = translation[l].x;
+					tmp[1][l] = translation[l].y;
+					tmp[2][l] = translation[l].z;
+					tmp[3][l] = scale[l].x;
+					tmp[4][l] = scale[l].y;
+					tmp[5][l] = scale[l].z;
+				}
+
+				V q[4], m[12];
+				load_soa(rotation, q[0], q[1], q[2], q[3]);
+				quat_to_matrix_soa(q, m);
+				for (int32_t j = 0; j < 3; j++)
+				{
+					V s = vloadu<V>(tmp[3 + j]);
+					m[j] = vmul(m[j], s);
+					m[4 + j] = vmul(m[4 + j], s);
+					m[8 + j] = vmul(m[8 + j], s);
+					m[4 * j + 3] = vloadu<V>(tmp[j]);
+				}
+				store_soa(out, m);
+			}
+		}
+#endif
+
+		// e.g. bone matrices to the TRS space of animation tracks. The SIMD
+		// lanes run the scalar kernel and match it within rounding, not bit
+		// for bit, as FMA contraction can differ between the two
+		inline void decompose(const float3x4* m, float3* translation, float4* rotation, float3* scale, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::decompose_block<__m256>(m + i, translation + i, rotation + i, scale + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::decompose_block<__m128>(m + i, translation + i, rotation + i, scale + i);
+#endif
+			for (; i < n; i++)
+				decompose(m[i], translation[i], rotation[i], scale[i]);
+		}
+
+		inline void compose(const float3* translation, const float4* rotation, const float3* scale, float3x4* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::compose_block<__m256>(translation + i, rotation + i, scale + i, out + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::compose_block<__m128>(translation + i, rotation + i, scale + i, out + i);
+#endif
+			for (; i < n; i++)
+				out[i] = compose(translation[i], rotation[i], scale[i]);
+		}
+
+		// smallest three quaternion compression
+		// the largest component is dropped and rebuilt from the unit length,
+		// the other three lie in [-1/sqrt(2), 1/sqrt(2)] and are quantized.
+		// q and -q are the same rotation, so the largest one is made positive
+
+		namespace detail
+		{
+			const float quatRange = 0.707106781f;
+
+			inline uint32_t quat_largest(const float4& q)
+			{
+				float a[4] = { std::fabs(q.x), std::fabs(q.y), std::fabs(q.z), std::fabs(q.w) };
+				uint32_t largest = 0;
+				for (uint32_t i = 1; i < 4; i++)
+					largest = a[i] > a[largest] ? i : largest;
+				return largest;
+			}
+
+			// the three smallest components in order, quantized to bits each
+			inline void quat_smallest_three(const float4& q, uint32_t largest, uint32_t bits, uint32_t* out)
+			{
+				const float* c = &q.x;
+				float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+				float maxValue = float((1u << bits) - 1);
+				for (uint32_t i = 0, j = 0; i < 4; i++)
+				{
+					if (i == largest)
+						continue;
+					float v = clamp(c[i] * sign * (0.5f / quatRange) + 0.5f, 0.0f, 1.0f);
+					out[j++] = uint32_t(std::lrint(v * maxValue));
+				}
+			}
+
+			inline float4 quat_from_smallest_three(uint32_t largest, float a, float b, float c)
+			{
+				float d = 1.0f - a * a - b * b - c * c;
+				d = std::sqrt(d > 0.0f ? d : 0.0f);
+				switch (largest)
+				{
+				case 0: return float4{ d, a, b, c };
+				case 1: return float4{ a, d, b, c };
+				case 2: return float4{ a, b, d, c };
+				default: return float4{ a, b, c, d };
+				}
+			}
+		}
+
+		// 2 bit index of the dropped component in the top bits of the first two
+		// words, rotation error below 0.01 degrees
+		inline quat48 packQuat48(const float4& q)
+		{
+			uint32_t largest = detail::quat_largest(q);
+			uint32_t v[3];
+			detail::quat_smallest_three(q, largest, 15, v);
+			return quat48{ {
+				uint16_t(v[0] | ((largest & 1) << 15)),
+				uint16_t(v[1] | ((largest >> 1) << 15)),
+				uint16_t(v[2])
+			} };
+		}
+
+		inline float4 unpackQuat48(const quat48& p)
+		{
+			const float scale = 2.0f * detail::quatRange / 32767.0f;
+			uint32_t largest = (p.bits[0] >> 15) | ((p.bits[1] >> 15) << 1);
+			return detail::quat_from_smallest_three(largest,
+				float(p.bits[0] & 0x7fffu) * scale - detail::quatRange,
+				float(p.bits[1] & 0x7fffu) * scale - detail::quatRange,
+				float(p.bits[2] & 0x7fffu) * scale - detail::quatRange);
+		}
+
+		// 10 bits per component, index in the top 2 bits, rotation error below 0.25 degrees
+		inline uint32_t packQuat32(const float4& q)
+		{
+			uint32_t largest = detail::quat_largest(q);
+			uint32_t v[3];
+			detail::quat_smallest_three(q, largest, 10, v);
+			return v[0] | (v[1] << 10) | (v[2] << 20) | (largest << 30);
+		}
+
+		inline float4 unpackQuat32(uint32_t p)
+		{
+			const float scale = 2.0f * detail::quatRange / 1023.0f;
+			return detail::quat_from_smallest_three(p >> 30,
+				float(p & 0x3ffu) * scale - detail::quatRange,
+				float((p >> 10) & 0x3ffu) * scale - detail::quatRange,
+				float((p >> 20) & 0x3ffu) * scale - detail::quatRange);
+		}
+
+#if defined(TOFU_MATH_SSE2)
+		namespace detail
+		{
+			inline __m128 vcvtepi32(__m128i a) { return _mm_cvtepi32_ps(a); }
+			inline __m128i vsrli(__m128i a, int32_t n) { return _mm_srli_epi32(a, n); }
+			inline __m128i vandi(__m128i a, int32_t mask) { return _mm_and_si128(a, _mm_set1_epi32(mask)); }
+			inline __m128i vor(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+			inline __m128 vmask(__m128i index, int32_t i) { return _mm_castsi128_ps(_mm_cmpeq_epi32(index, _mm_set1_epi32(i))); }
+			template<typename I> inline I vloadu_epi32(const void* p);
+			template<> inline __m128i vloadu_epi32<__m128i>(const void* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+
+#if defined(TOFU_MATH_AVX2)
+			inline __m256 vcvtepi32(__m256i a) { return _mm256_cvtepi32_ps(a); }
+			inline __m256i vsrli(__m256i a, int32_t n) { return _mm256_srli_epi32(a, n); }
+			inline __m256i vandi(__m256i a, int32_t mask) { return _mm256_and_si256(a, _mm256_set1_epi32(mask)); }
+			inline __m256i vor(__m256i a, __m256i b) { return _mm256_or_si256(a, b); }
+			inline __m256 vmask(__m256i index, int32_t i) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(index, _mm256_set1_epi32(i))); }
+			template<> inline __m256i vloadu_epi32<__m256i>(const void* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+#endif
+
+			// same steps as quat_from_smallest_three, lanes hold the quantized
+			// components and the dropped component index
+			template<typename V, typename I>
+			inline void quat_from_smallest_three_block(I ia, I ib, I ic, I largest, float scale, float4* out)
+			{
+				V s = vset1<V>(scale);
+				V range = vset1<V>(quatRange);
+				V a = vsub(vmul(vcvtepi32(ia), s), range);
+				V b = vsub(vmul(vcvtepi32(ib), s), range);
+				V c = vsub(vmul(vcvtepi32(ic), s), range);
+
+				V d = vsub(vsub(vsub(vset1<V>(1.0f), vmul(a, a)), vmul(b, b)), vmul(c, c));
+				d = vsqrt(vmax(d, vset1<V>(0.0f)));
+
+				V is0 = vmask(largest, 0);
+				V is1 = vmask(largest, 1);
+				V is2 = vmask(largest, 2);
+				V is3 = vmask(largest, 3);
+
+				V x = vselect(is0, d, a);
+				V y = vselect(is1, d, vselect(is0, a, b));
+				V z = vselect(is2, d, vselect(is3, c, b));
+				V w = vselect(is3, d, c);
+				store_soa(out, x, y, z, w);
+			}
+
+			template<typename V, typename I>
+			inline void unpack_quat32_block(const uint32_t* p, float4* out)
+			{
+				I v = vloadu_epi32<I>(p);
+				quat_from_smallest_three_block<V, I>(vandi(v, 0x3ff), vandi(vsrli(v, 10), 0x3ff), vandi(vsrli(v, 20), 0x3ff),
+					vsrli(v, 30), 2.0f * quatRange / 1023.0f, out);
+			}
+
+			template<typename V, typename I>
+			inline void unpack_quat48_block(const quat48* p, float4* out)
+			{
+				// 6 byte records do not line up with lanes, spread the words first
+				const uint32_t lanes = sizeof(V) / sizeof(float);
+				int32_t raw[3][8];
+				for (uint32_t l = 0; l < lanes; l++)
+				{
+					raw[0][l] = p[l].bits[0];
+					raw[1][l] = p[l].bits[1];
+					raw[2][l] = p[l].bits[2];
+				}
+				I w0 = vloadu_epi32<I>(raw[0]);
+				I w1 = vloadu_epi32<I>(raw[1]);
+				I w2 = vloadu_epi32<I>(raw[2]);
+				I largest = vor(vsrli(w0, 15), vandi(vsrli(w1, 14), 2));
+				quat_from_smallest_three_block<V, I>(vandi(w0, 0x7fff), vandi(w1, 0x7fff), vandi(w2, 0x7fff),
+					largest, 2.0f * quatRange / 32767.0f, out);
+			}
+		}
+#endif
+
+		inline void unpackQuat32(const uint32_t* in, float4* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::unpack_quat32_block<__m256, __m256i>(in + i, out + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::unpack_quat32_block<__m128, __m128i>(in + i, out + i);
+#endif
+			for (; i < n; i++)
+				out[i] = unpackQuat32(in[i]);
+		}
+
+		inline void unpackQuat48(const quat48* in, float4* out, size_t n)
+		{
+			size_t i = 0;
+#if defined(TOFU_MATH_AVX2)
+			for (; i + 8 <= n; i += 8)
+				detail::unpack_quat48_block<__m256, __m256i>(in + i, out + i);
+#endif
+#if defined(TOFU_MATH_SSE2)
+			for (; i + 4 <= n; i += 4)
+				detail::unpack_quat48_block<__m128, __m128i>(in + i, out + i);
+#endif
+			for (; i < n; i++)
+				out[i] = unpackQuat48(in[i]);
+		}
 	}
 }
\ No newline at end of file
@@ -7,6 +7,8 @@ namespace tofu
 	using math::int4;
 	using math::float3;
 	using math::float4;
+	using math::aabb;
+	using math::quat48;
 
 	struct Vertex
 	{
@@ -42,6 +44,7 @@ namespace tofu
 		uint32_t	startIndex;
 		uint32_t	numVertices;
 		uint32_t	numIndices;
+		aabb		bounds;
 	};
 
 	struct VectorFrame
@@ -56,6 +59,20 @@ namespace tofu
 		float		time;
 	};
 
+	// compressed rotation keys, see math::packQuat48 and math::packQuat32
+	struct QuaternionFrame48
+	{
+		quat48		value;
+		uint16_t	_reserved;
+		float		time;
+	};
+
+	struct QuaternionFrame32
+	{
+		uint32_t	value;
+		float		time;
+	};
+
 	struct Track
 	{
 		uint32_t	transFrames;
@@ -75,6 +92,72 @@ namespace tofu
 		uint32_t	numTracks;
 	};
 
+	// 'TFMD' read as a little endian uint32_t
+	const uint32_t TFModelMagic = 0x444d4654u;
+	const uint32_t TFModelVersion = 4;
+
+	// every section starts at a multiple of this from the start of the file
+	const uint32_t TFModelAlignment = 16;
+
+	// TFModel::flags
+	const uint32_t TFModelChunked = 1;
+
+	// chunked files put what the first frame needs at the front: meshes whose
+	// ranges refer to a coarse LOD in the vertex and index sections, bones,
+	// animation headers, strings and the chunk table. Full detail geometry of
+	// each mesh and the tracks and frames of each animation follow as chunks
+	// starting on page boundaries, so each one can be read or mapped alone.
+	// There is no node hierarchy, the head has the flattened mesh matrices
+	// and the bone tree in its place
+	const uint32_t TFModelChunkAlignment = 4096;
+
+	enum TFChunkType : uint32_t
+	{
+		TFChunkGeometry = 1,	// SkinnedVertex[count[0]], uint32_t indices[count[1]]
+		TFChunkAnimation = 2	// Track[count[0]], VectorFrame[count[1]], QuaternionFrame[count[2]]
+	};
+
+	// arrays inside a chunk start on TFModelAlignment boundaries relative to
+	// the chunk, indices and frame indices are local to the chunk
+	struct TFChunk
+	{
+		uint32_t	type;
+		uint32_t	index;		// mesh or animation
+		uint32_t	start;		// byte offset from the start of the file
+		uint32_t	size;
+		uint32_t	count[3];
+		uint32_t	crc;		// CRC32C of the size bytes at start
+	};
+
+	// slot of the open addressed table mapping name hashes to bones. The
+	// table size is a power of two, lookups probe linearly from
+	// hash & (size - 1) until the hash or an empty slot (bone -1) is found
+	struct TFNameSlot
+	{
+		uint64_t	hash;		// XXH64 of the name, without the terminator
+		int32_t		bone;
+		uint32_t	_reserved;
+	};
+
+	// sections of a TFModel file in file order
+	enum TFSection : uint32_t
+	{
+		TFSectionVertices,
+		TFSectionMeshes,
+		TFSectionBones,
+		TFSectionAnims,
+		TFSectionStrings,
+		TFSectionNames,
+		TFSectionIndices,
+		TFSectionTracks,
+		TFSectionVectorFrames,
+		TFSectionQuatFrames,
+		TFSectionChunks,
+		TFSectionCount
+	};
+
+	// file header, *Start fields are byte offsets from the start of the file,
+	// the sections follow in the order of the fields below
 	struct TFModel
 	{
 		uint32_t	magic;
@@ -85,5 +168,31 @@ namespace tofu
 		uint32_t	boneStart;
 		uint32_t	animStart;
 		uint32_t	stringStart;
+		uint32_t	nameStart;
+
+		uint32_t	indexStart;
+		uint32_t	trackStart;
+		uint32_t	vectorFrameStart;
+		uint32_t	quatFrameStart;
+		uint32_t	chunkStart;
+
+		uint32_t	numVertices;	// SkinnedVertex
+		uint32_t	numIndices;		// uint32_t
+		uint32_t	numMeshes;
+		uint32_t	numBones;
+		uint32_t	numAnims;
+		uint32_t	numTracks;
+		uint32_t	numVectorFrames;
+		uint32_t	numQuatFrames;
+		uint32_t	numChunks;
+		uint32_t	stringSize;		// bytes, names are null terminated
+		uint32_t	numNameSlots;	// TFNameSlot, 0 or a power of two
+		uint32_t	headSize;		// bytes up to the first chunk
+		uint32_t	fileSize;
+
+		// indexed by TFSection, sizes leave out the padding after a section
+		uint32_t	sectionSize[TFSectionCount];
+		uint32_t	sectionCrc[TFSectionCount];		// CRC32C
+		uint32_t	headerCrc;		// CRC32C of the header with this field zero
 	};
 }
\ No newline at end of file
@@ -0,0 +1,1075 @@
+#include "TofuModel.h"
+
+#include <cstdio>
+#include <vector>
+#include <unordered_map>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TOFU_MODEL_X86
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TOFU_TARGET_SSE42
+#else
+#include <cpuid.h>
+#define TOFU_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+namespace
+{
+	using namespace tofu;
+
+	uint64_t align(uint64_t offset, uint64_t alignment = TFModelAlignment)
+	{
+		return (offset + alignment - 1) & ~(alignment - 1);
+	}
+
+	// XXH64 constants
+	const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+	const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+	const uint64_t prime3 = 0x165667B19E3779F9ull;
+	const uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+	const uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+	inline uint64_t rotl(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	inline uint64_t read64(const uint8_t* p)
+	{
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint32_t read32(const uint8_t* p)
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint64_t xxh_round(uint64_t acc, uint64_t input)
+	{
+		acc += input * prime2;
+		return rotl(acc, 31) * prime1;
+	}
+
+	inline uint64_t merge_round(uint64_t acc, uint64_t v)
+	{
+		acc ^= xxh_round(0, v);
+		return acc * prime1 + prime4;
+	}
+
+	// slicing-by-8 tables of the reflected CRC32C polynomial
+	struct Crc32cTables
+	{
+		uint32_t t[8][256];
+
+		Crc32cTables()
+		{
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				uint32_t crc = i;
+				for (uint32_t j = 0; j < 8; j++)
+					crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+				t[0][i] = crc;
+			}
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				for (uint32_t j = 1; j < 8; j++)
+					t[j][i] = (t[j - 1][i] >> 8) ^ t[0][t[j - 1][i] & 0xff];
+			}
+		}
+	};
+
+	uint32_t crc32c_table(const uint8_t* p, size_t size, uint32_t crc)
+	{
+		static const Crc32cTables tables;
+		const uint32_t (*t)[256] = tables.t;
+
+		for (; size >= 8; size -= 8, p += 8)
+		{
+			uint32_t lo, hi;
+			memcpy(&lo, p, 4);
+			memcpy(&hi, p + 4, 4);
+			lo ^= crc;
+			crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+				t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+		}
+
+		for (; size > 0; size--, p++)
+			crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+		return crc;
+	}
+
+#ifdef TOFU_MODEL_X86
+	TOFU_TARGET_SSE42 uint32_t crc32c_sse42(const uint8_t* p, size_t size, uint32_t crc)
+	{
+#if defined(_M_X64) || defined(__x86_64__)
+		uint64_t crc64 = crc;
+		for (; size >= 8; size -= 8, p += 8)
+		{
+			uint64_t v;
+			memcpy(&v, p, 8);
+			crc64 = _mm_crc32_u64(crc64, v);
+		}
+		crc = uint32_t(crc64);
+#endif
+		for (; size >= 4; size -= 4, p += 4)
+		{
+			uint32_t v;
+			memcpy(&v, p, 4);
+			crc = _mm_crc32_u32(crc, v);
+		}
+		for (; size > 0; size--, p++)
+			crc = _mm_crc32_u8(crc, *p);
+		return crc;
+	}
+
+	bool has_sse42()
+	{
+		int info[4] = {};
+#ifdef _MSC_VER
+		__cpuid(info, 1);
+#else
+		__cpuid(1, info[0], info[1], info[2], info[3]);
+#endif
+		return 0 != (info[2] & (1 << 20));
+	}
+#endif
+
+	// TFModel fields holding the start of each TFSection
+	uint32_t TFModel::* const sectionStarts[TFSectionCount] =
+	{
+		&TFModel::vertexStart,
+		&TFModel::meshStart,
+		&TFModel::boneStart,
+		&TFModel::animStart,
+		&TFModel::stringStart,
+		&TFModel::nameStart,
+		&TFModel::indexStart,
+		&TFModel::trackStart,
+		&TFModel::vectorFrameStart,
+		&TFModel::quatFrameStart,
+		&TFModel::chunkStart,
+	};
+
+	// the arrays of model written as each TFSection, 64 bit so a model too
+	// large for the format is caught instead of wrapping
+	void section_data(const ModelData& model, const void** data, uint64_t* sizes)
+	{
+		data[TFSectionVertices] = model.vertices;
+		sizes[TFSectionVertices] = uint64_t(model.numVertices) * sizeof(SkinnedVertex);
+		data[TFSectionMeshes] = model.meshes;
+		sizes[TFSectionMeshes] = uint64_t(model.numMeshes) * sizeof(Mesh);
+		data[TFSectionBones] = model.bones;
+		sizes[TFSectionBones] = uint64_t(model.numBones) * sizeof(Bone);
+		data[TFSectionAnims] = model.anims;
+		sizes[TFSectionAnims] = uint64_t(model.numAnims) * sizeof(Animation);
+		data[TFSectionStrings] = model.strings;
+		sizes[TFSectionStrings] = model.stringSize;
+		data[TFSectionNames] = model.names;
+		sizes[TFSectionNames] = uint64_t(model.numNameSlots) * sizeof(TFNameSlot);
+		data[TFSectionIndices] = model.indices;
+		sizes[TFSectionIndices] = uint64_t(model.numIndices) * sizeof(uint32_t);
+		data[TFSectionTracks] = model.tracks;
+		sizes[TFSectionTracks] = uint64_t(model.numTracks) * sizeof(Track);
+		data[TFSectionVectorFrames] = model.vectorFrames;
+		sizes[TFSectionVectorFrames] = uint64_t(model.numVectorFrames) * sizeof(VectorFrame);
+		data[TFSectionQuatFrames] = model.quatFrames;
+		sizes[TFSectionQuatFrames] = uint64_t(model.numQuatFrames) * sizeof(QuaternionFrame);
+		data[TFSectionChunks] = model.chunks;
+		sizes[TFSectionChunks] = uint64_t(model.numChunks) * sizeof(TFChunk);
+	}
+
+	// section sizes implied by the counts in header, 64 bit so they cannot wrap
+	void section_sizes(const TFModel& header, uint64_t* sizes)
+	{
+		sizes[TFSectionVertices] = uint64_t(header.numVertices) * sizeof(SkinnedVertex);
+		sizes[TFSectionMeshes] = uint64_t(header.numMeshes) * sizeof(Mesh);
+		sizes[TFSectionBones] = uint64_t(header.numBones) * sizeof(Bone);
+		sizes[TFSectionAnims] = uint64_t(header.numAnims) * sizeof(Animation);
+		sizes[TFSectionStrings] = header.stringSize;
+		sizes[TFSectionNames] = uint64_t(header.numNameSlots) * sizeof(TFNameSlot);
+		sizes[TFSectionIndices] = uint64_t(header.numIndices) * sizeof(uint32_t);
+		sizes[TFSectionTracks] = uint64_t(header.numTracks) * sizeof(Track);
+		sizes[TFSectionVectorFrames] = uint64_t(header.numVectorFrames) * sizeof(VectorFrame);
+		sizes[TFSectionQuatFrames] = uint64_t(header.numQuatFrames) * sizeof(QuaternionFrame);
+		sizes[TFSectionChunks] = uint64_t(header.numChunks) * sizeof(TFChunk);
+	}
+
+	uint32_t header_crc(const TFModel& header)
+	{
+		TFModel h = header;
+		h.headerCrc = 0;
+		return crc32c(&h, sizeof(TFModel));
+	}
+
+	// pads the file from offset up to start, then writes size bytes
+	int32_t write_section(FILE* file, uint32_t& offset, uint32_t start, const void* data, uint32_t size)
+	{
+		static const char zeros[TFModelChunkAlignment] = {};
+
+		while (offset < start)
+		{
+			uint32_t padding = start - offset < TFModelChunkAlignment ? start - offset : TFModelChunkAlignment;
+			if (1 != fwrite(zeros, padding, 1, file))
+				return -1;
+			offset += padding;
+		}
+
+		if (size > 0 && 1 != fwrite(data, size, 1, file))
+			return -1;
+
+		offset = start + size;
+		return 0;
+	}
+
+	int32_t write_head(FILE* file, uint32_t& offset, const TFModel& header, const ModelData& model)
+	{
+		TFModel h = header;
+		h.headerCrc = header_crc(h);
+		if (0 != write_section(file, offset, 0, &h, sizeof(TFModel)))
+			return -1;
+
+		// sizes were checked to fit by layout_model
+		const void* data[TFSectionCount];
+		uint64_t sizes[TFSectionCount];
+		section_data(model, data, sizes);
+		for (uint32_t i = 0; i < TFSectionCount; i++)
+		{
+			if (0 != write_section(file, offset, header.*sectionStarts[i], data[i], uint32_t(sizes[i])))
+				return -1;
+		}
+		return 0;
+	}
+
+	// offsets of the arrays inside a chunk and its total size, 64 bit so
+	// counts read from a file cannot wrap around
+	uint64_t chunk_layout(uint32_t type, const uint32_t* count, uint64_t* offsets)
+	{
+		uint64_t sizes[3] = {};
+		if (type == TFChunkGeometry)
+		{
+			sizes[0] = uint64_t(count[0]) * sizeof(SkinnedVertex);
+			sizes[1] = uint64_t(count[1]) * sizeof(uint32_t);
+		}
+		else
+		{
+			sizes[0] = uint64_t(count[0]) * sizeof(Track);
+			sizes[1] = uint64_t(count[1]) * sizeof(VectorFrame);
+			sizes[2] = uint64_t(count[2]) * sizeof(QuaternionFrame);
+		}
+
+		uint64_t offset = 0;
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			offsets[i] = offset;
+			offset = (offset + sizes[i] + TFModelAlignment - 1) & ~uint64_t(TFModelAlignment - 1);
+		}
+		return offsets[2] + sizes[2];
+	}
+
+	// vertex clustering: vertices in the same grid cell merge into the first
+	// one seen and triangles that collapse are dropped. Indices stay relative
+	// to the mesh, appended to outVertices and outIndices
+	void cluster_mesh(const SkinnedVertex* vertices, uint32_t numVertices, const uint32_t* indices, uint32_t numIndices,
+		uint32_t cells, std::vector<SkinnedVertex>& outVertices, std::vector<uint32_t>& outIndices)
+	{
+		if (0 == numVertices)
+			return;
+
+		float3 lo = vertices[0].position;
+		float3 hi = vertices[0].position;
+		for (uint32_t i = 1; i < numVertices; i++)
+		{
+			const float3& p = vertices[i].position;
+			lo = float3{ p.x < lo.x ? p.x : lo.x, p.y < lo.y ? p.y : lo.y, p.z < lo.z ? p.z : lo.z };
+			hi = float3{ p.x > hi.x ? p.x : hi.x, p.y > hi.y ? p.y : hi.y, p.z > hi.z ? p.z : hi.z };
+		}
+
+		float3 extent = hi - lo;
+		float longest = extent.x > extent.y ? extent.x : extent.y;
+		longest = extent.z > longest ? extent.z : longest;
+		float scale = longest > 0.0f ? float(cells) / longest : 0.0f;
+
+		uint32_t base = uint32_t(outVertices.size());
+		std::unordered_map<uint64_t, uint32_t> cellTable;
+		std::vector<uint32_t> remap(numVertices);
+		for (uint32_t i = 0; i < numVertices; i++)
+		{
+			float3 c = (vertices[i].position - lo) * scale;
+			uint64_t x = uint64_t(c.x < float(cells) ? c.x : float(cells - 1));
+			uint64_t y = uint64_t(c.y < float(cells) ? c.y : float(cells - 1));
+			uint64_t z = uint64_t(c.z < float(cells) ? c.z : float(cells - 1));
+			uint64_t key = x | (y << 21) | (z << 42);
+
+			auto it = cellTable.find(key);
+			if (it == cellTable.end())
+			{
+				it = cellTable.insert(std::make_pair(key, uint32_t(outVertices.size()) - base)).first;
+				outVertices.push_back(vertices[i]);
+			}
+			remap[i] = it->second;
+		}
+
+		for (uint32_t i = 0; i + 2 < numIndices; i += 3)
+		{
+			uint32_t a = remap[indices[i]];
+			uint32_t b = remap[indices[i + 1]];
+			uint32_t c = remap[indices[i + 2]];
+			if (a == b || b == c || c == a)
+				continue;
+			outIndices.push_back(a);
+			outIndices.push_back(b);
+			outIndices.push_back(c);
+		}
+	}
+
+	// count elements of elementSize at start must lie after the header and
+	// inside the head, 64 bit math so large counts cannot wrap around
+	bool check_section(const TFModel& header, uint32_t start, uint32_t count, size_t elementSize)
+	{
+		if (start % TFModelAlignment != 0 || start < sizeof(TFModel))
+			return false;
+		return uint64_t(start) + uint64_t(count) * elementSize <= header.headSize;
+	}
+
+	bool check_range(uint32_t first, uint32_t count, uint32_t size)
+	{
+		return uint64_t(first) + count <= size;
+	}
+
+	// -1 marks a missing link
+	bool check_link(int32_t index, uint32_t size)
+	{
+		return index >= -1 && index < int64_t(size);
+	}
+}
+
+namespace tofu
+{
+	uint64_t hash_bytes(const void* data, size_t size, uint64_t seed)
+	{
+		const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+		const uint8_t* end = p + size;
+		uint64_t h;
+
+		if (size >= 32)
+		{
+			uint64_t v1 = seed + prime1 + prime2;
+			uint64_t v2 = seed + prime2;
+			uint64_t v3 = seed;
+			uint64_t v4 = seed - prime1;
+
+			const uint8_t* limit = end - 32;
+			do
+			{
+				v1 = xxh_round(v1, read64(p));
+				v2 = xxh_round(v2, read64(p + 8));
+				v3 = xxh_round(v3, read64(p + 16));
+				v4 = xxh_round(v4, read64(p + 24));
+				p += 32;
+			} while (p <= limit);
+
+			h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+			h = merge_round(h, v1);
+			h = merge_round(h, v2);
+			h = merge_round(h, v3);
+			h = merge_round(h, v4);
+		}
+		else
+		{
+			h = seed + prime5;
+		}
+
+		h += uint64_t(size);
+
+		for (; p + 8 <= end; p += 8)
+			h = rotl(h ^ xxh_round(0, read64(p)), 27) * prime1 + prime4;
+
+		if (p + 4 <= end)
+		{
+			h = rotl(h ^ (uint64_t(read32(p)) * prime1), 23) * prime2 + prime3;
+			p += 4;
+		}
+
+		for (; p < end; p++)
+			h = rotl(h ^ (uint64_t(*p) * prime5), 11) * prime1;
+
+		h ^= h >> 33;
+		h *= prime2;
+		h ^= h >> 29;
+		h *= prime3;
+		h ^= h >> 32;
+		return h;
+	}
+
+	uint32_t name_table_size(uint32_t count)
+	{
+		uint32_t size = count > 0 ? 2 : 0;
+		while (size < count * 2)
+			size *= 2;
+		return size;
+	}
+
+	int32_t build_name_table(const Bone* bones, uint32_t numBones, const char* strings,
+		TFNameSlot* slots, uint32_t numSlots)
+	{
+		if (numSlots < numBones * 2 || 0 != (numSlots & (numSlots - 1)))
+			return -1;
+
+		for (uint32_t i = 0; i < numSlots; i++)
+		{
+			slots[i].hash = 0;
+			slots[i].bone = -1;
+			slots[i]._reserved = 0;
+		}
+
+		for (uint32_t i = 0; i < numBones; i++)
+		{
+			uint64_t hash = hash_name(strings + bones[i].name);
+			uint32_t slot = uint32_t(hash) & (numSlots - 1);
+			while (slots[slot].bone != -1)
+			{
+				if (slots[slot].hash == hash)
+					return -1;
+				slot = (slot + 1) & (numSlots - 1);
+			}
+			slots[slot].hash = hash;
+			slots[slot].bone = int32_t(i);
+		}
+		return 0;
+	}
+
+	int32_t find_name(const TFNameSlot* slots, uint32_t numSlots, uint64_t hash)
+	{
+		if (0 == numSlots)
+			return -1;
+
+		uint32_t slot = uint32_t(hash) & (numSlots - 1);
+		for (uint32_t i = 0; i < numSlots; i++)
+		{
+			const TFNameSlot& s = slots[slot];
+			if (s.bone == -1 || s.hash == hash)
+				return s.bone;
+			slot = (slot + 1) & (numSlots - 1);
+		}
+		return -1;
+	}
+
+	uint32_t crc32c(const void* data, size_t size, uint32_t crc)
+	{
+		typedef uint32_t(*Crc32cFunc)(const uint8_t*, size_t, uint32_t);
+#ifdef TOFU_MODEL_X86
+		static const Crc32cFunc func = has_sse42() ? crc32c_sse42 : crc32c_table;
+#else
+		static const Crc32cFunc func = crc32c_table;
+#endif
+		return ~func(reinterpret_cast<const uint8_t*>(data), size, ~crc);
+	}
+
+	int32_t layout_model(const ModelData& model, TFModel& header)
+	{
+		header = TFModel();
+		header.magic = TFModelMagic;
+		header.version = TFModelVersion;
+
+		header.numVertices = model.numVertices;
+		header.numIndices = model.numIndices;
+		header.numMeshes = model.numMeshes;
+		header.numBones = model.numBones;
+		header.numAnims = model.numAnims;
+		header.numTracks = model.numTracks;
+		header.numVectorFrames = model.numVectorFrames;
+		header.numQuatFrames = model.numQuatFrames;
+		header.stringSize = model.stringSize;
+		header.numNameSlots = model.numNameSlots;
+		header.numChunks = model.numChunks;
+
+		const void* data[TFSectionCount];
+		uint64_t sizes[TFSectionCount];
+		section_data(model, data, sizes);
+
+		uint64_t offset = sizeof(TFModel);
+		for (uint32_t i = 0; i < TFSectionCount; i++)
+		{
+			offset = align(offset);
+			if (offset + sizes[i] > UINT32_MAX)
+				return -1;
+
+			header.*sectionStarts[i] = uint32_t(offset);
+			header.sectionSize[i] = uint32_t(sizes[i]);
+			header.sectionCrc[i] = crc32c(data[i], size_t(sizes[i]));
+			offset += sizes[i];
+		}
+		header.headSize = uint32_t(offset);
+		header.fileSize = uint32_t(offset);
+		return 0;
+	}
+
+	int32_t write_model(const char* filename, const ModelData& model)
+	{
+		TFModel header;
+		if (0 != layout_model(model, header))
+			return -1;
+
+		FILE* file = fopen(filename, "wb");
+		if (nullptr == file)
+			return -1;
+
+		uint32_t offset = 0;
+		int32_t ret = write_head(file, offset, header, model);
+
+		if (0 != fclose(file))
+			ret = -1;
+
+		return ret;
+	}
+
+	int32_t write_model_chunked(const char* filename, const ModelData& model, uint32_t coarseCells)
+	{
+		if (coarseCells == 0 || coarseCells >= (1u << 21))
+			return -1;
+
+		// the head: coarse geometry, meshes pointing at it and animation
+		// headers whose tracks live in the chunks
+		std::vector<SkinnedVertex> coarseVertices;
+		std::vector<uint32_t> coarseIndices;
+		std::vector<Mesh> meshes(model.meshes, model.meshes + model.numMeshes);
+		for (uint32_t i = 0; i < model.numMeshes; i++)
+		{
+			Mesh& m = meshes[i];
+			uint32_t startVertex = uint32_t(coarseVertices.size());
+			uint32_t startIndex = uint32_t(coarseIndices.size());
+			cluster_mesh(model.vertices + m.startVertex, m.numVertices, model.indices + m.startIndex, m.numIndices,
+				coarseCells, coarseVertices, coarseIndices);
+			m.startVertex = startVertex;
+			m.startIndex = startIndex;
+			m.numVertices = uint32_t(coarseVertices.size()) - startVertex;
+			m.numIndices = uint32_t(coarseIndices.size()) - startIndex;
+		}
+
+		// tracks and frames of each animation, frame indices made chunk local
+		std::vector<Animation> anims(model.anims, model.anims + model.numAnims);
+		std::vector<std::vector<Track>> animTracks(model.numAnims);
+		std::vector<std::vector<VectorFrame>> animVectorFrames(model.numAnims);
+		std::vector<std::vector<QuaternionFrame>> animQuatFrames(model.numAnims);
+		for (uint32_t i = 0; i < model.numAnims; i++)
+		{
+			const Animation& a = model.anims[i];
+			for (uint32_t j = 0; j < a.numTracks; j++)
+			{
+				Track t = model.tracks[a.tracks + j];
+				std::vector<VectorFrame>& vf = animVectorFrames[i];
+				std::vector<QuaternionFrame>& qf = animQuatFrames[i];
+
+				uint32_t transFrames = uint32_t(vf.size());
+				vf.insert(vf.end(), model.vectorFrames + t.transFrames, model.vectorFrames + t.transFrames + t.numTransFrames);
+				uint32_t scaleFrames = uint32_t(vf.size());
+				vf.insert(vf.end(), model.vectorFrames + t.scaleFrames, model.vectorFrames + t.scaleFrames + t.numScaleFrames);
+				uint32_t rotFrames = uint32_t(qf.size());
+				qf.insert(qf.end(), model.quatFrames + t.rotFrames, model.quatFrames + t.rotFrames + t.numRotFrames);
+
+				t.transFrames = transFrames;
+				t.scaleFrames = scaleFrames;
+				t.rotFrames = rotFrames;
+				animTracks[i].push_back(t);
+			}
+			anims[i].tracks = 0;
+		}
+
+		std::vector<TFChunk> chunks(model.numMeshes + model.numAnims);
+		for (uint32_t i = 0; i < model.numMeshes; i++)
+		{
+			TFChunk& c = chunks[i];
+			c = TFChunk();
+			c.type = TFChunkGeometry;
+			c.index = i;
+			c.count[0] = model.meshes[i].numVertices;
+			c.count[1] = model.meshes[i].numIndices;
+		}
+		for (uint32_t i = 0; i < model.numAnims; i++)
+		{
+			TFChunk& c = chunks[model.numMeshes + i];
+			c = TFChunk();
+			c.type = TFChunkAnimation;
+			c.index = i;
+			c.count[0] = uint32_t(animTracks[i].size());
+			c.count[1] = uint32_t(animVectorFrames[i].size());
+			c.count[2] = uint32_t(animQuatFrames[i].size());
+		}
+
+		ModelData head = {};
+		head.vertices = coarseVertices.data();
+		head.numVertices = uint32_t(coarseVertices.size());
+		head.indices = coarseIndices.data();
+		head.numIndices = uint32_t(coarseIndices.size());
+		head.meshes = meshes.data();
+		head.numMeshes = uint32_t(meshes.size());
+		head.bones = model.bones;
+		head.numBones = model.numBones;
+		head.anims = anims.data();
+		head.numAnims = uint32_t(anims.size());
+		head.strings = model.strings;
+		head.stringSize = model.stringSize;
+		head.names = model.names;
+		head.numNameSlots = model.numNameSlots;
+		head.chunks = chunks.data();
+		head.numChunks = uint32_t(chunks.size());
+
+		auto chunk_arrays = [&](const TFChunk& c, const void** data, uint32_t* sizes)
+		{
+			if (c.type == TFChunkGeometry)
+			{
+				const Mesh& m = model.meshes[c.index];
+				data[0] = model.vertices + m.startVertex;
+				sizes[0] = m.numVertices * sizeof(SkinnedVertex);
+				data[1] = model.indices + m.startIndex;
+				sizes[1] = m.numIndices * sizeof(uint32_t);
+				data[2] = nullptr;
+				sizes[2] = 0;
+			}
+			else
+			{
+				data[0] = animTracks[c.index].data();
+				sizes[0] = c.count[0] * sizeof(Track);
+				data[1] = animVectorFrames[c.index].data();
+				sizes[1] = c.count[1] * sizeof(VectorFrame);
+				data[2] = animQuatFrames[c.index].data();
+				sizes[2] = c.count[2] * sizeof(QuaternionFrame);
+			}
+		};
+
+		TFModel header;
+		if (0 != layout_model(head, header))
+			return -1;
+
+		uint64_t end = header.headSize;
+		for (TFChunk& c : chunks)
+		{
+			uint64_t offsets[3];
+			uint64_t size = chunk_layout(c.type, c.count, offsets);
+			uint64_t start = (end + TFModelChunkAlignment - 1) & ~uint64_t(TFModelChunkAlignment - 1);
+			end = start + size;
+			if (end > UINT32_MAX)
+				return -1;
+			c.start = uint32_t(start);
+			c.size = uint32_t(size);
+
+			// the padding between the arrays is part of the checksum
+			static const char zeros[TFModelAlignment] = {};
+			const void* data[3];
+			uint32_t sizes[3];
+			chunk_arrays(c, data, sizes);
+			c.crc = 0;
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				c.crc = crc32c(data[j], sizes[j], c.crc);
+				if (j < 2)
+					c.crc = crc32c(zeros, uint32_t(offsets[j + 1] - offsets[j]) - sizes[j], c.crc);
+			}
+		}
+
+		// again now that the chunk table is filled in, for its checksum
+		if (0 != layout_model(head, header))
+			return -1;
+		header.flags |= TFModelChunked;
+		header.fileSize = uint32_t(end);
+
+		FILE* file = fopen(filename, "wb");
+		if (nullptr == file)
+			return -1;
+
+		uint32_t offset = 0;
+		int32_t ret = write_head(file, offset, header, head);
+
+		for (uint32_t i = 0; i < chunks.size() && 0 == ret; i++)
+		{
+			const TFChunk& c = chunks[i];
+			uint64_t offsets[3];
+			chunk_layout(c.type, c.count, offsets);
+
+			const void* data[3];
+			uint32_t sizes[3];
+			chunk_arrays(c, data, sizes);
+
+			for (uint32_t j = 0; j < 3 && 0 == ret; j++)
+				ret = write_section(file, offset, c.start + uint32_t(offsets[j]), data[j], sizes[j]);
+		}
+
+		if (0 != fclose(file))
+			ret = -1;
+
+		return ret;
+	}
+
+	int32_t validate_model(const void* data, size_t size, ModelData& model)
+	{
+		model = ModelData();
+
+		if (nullptr == data || size < sizeof(TFModel) || reinterpret_cast<uintptr_t>(data) % TFModelAlignment != 0)
+			return -1;
+
+		const TFModel& header = *reinterpret_cast<const TFModel*>(data);
+		if (header.magic != TFModelMagic || header.version != TFModelVersion ||
+			header.headSize > header.fileSize || header.fileSize > size)
+			return -1;
+
+		if (!check_section(header, header.vertexStart, header.numVertices, sizeof(SkinnedVertex)) ||
+			!check_section(header, header.meshStart, header.numMeshes, sizeof(Mesh)) ||
+			!check_section(header, header.boneStart, header.numBones, sizeof(Bone)) ||
+			!check_section(header, header.animStart, header.numAnims, sizeof(Animation)) ||
+			!check_section(header, header.stringStart, header.stringSize, 1) ||
+			!check_section(header, header.nameStart, header.numNameSlots, sizeof(TFNameSlot)) ||
+			!check_section(header, header.indexStart, header.numIndices, sizeof(uint32_t)) ||
+			!check_section(header, header.trackStart, header.numTracks, sizeof(Track)) ||
+			!check_section(header, header.vectorFrameStart, header.numVectorFrames, sizeof(VectorFrame)) ||
+			!check_section(header, header.quatFrameStart, header.numQuatFrames, sizeof(QuaternionFrame)) ||
+			!check_section(header, header.chunkStart, header.numChunks, sizeof(TFChunk)))
+			return -1;
+
+		uint64_t sizes[TFSectionCount];
+		section_sizes(header, sizes);
+		for (uint32_t i = 0; i < TFSectionCount; i++)
+		{
+			if (sizes[i] != header.sectionSize[i])
+				return -1;
+		}
+
+		bool chunked = 0 != (header.flags & TFModelChunked);
+		if (!chunked && header.numChunks > 0)
+			return -1;
+
+		const uint8_t* base = reinterpret_cast<const uint8_t*>(data);
+		const Mesh* meshes = reinterpret_cast<const Mesh*>(base + header.meshStart);
+		const Bone* bones = reinterpret_cast<const Bone*>(base + header.boneStart);
+		const Animation* anims = reinterpret_cast<const Animation*>(base + header.animStart);
+		const Track* tracks = reinterpret_cast<const Track*>(base + header.trackStart);
+		const char* strings = reinterpret_cast<const char*>(base + header.stringStart);
+		const TFNameSlot* names = reinterpret_cast<const TFNameSlot*>(base + header.nameStart);
+		const TFChunk* chunks = reinterpret_cast<const TFChunk*>(base + header.chunkStart);
+
+		// names are looked up as C strings, the table must end with a terminator
+		if (header.stringSize > 0 && strings[header.stringSize - 1] != 0)
+			return -1;
+
+		if (0 != (header.numNameSlots & (header.numNameSlots - 1)))
+			return -1;
+
+		for (uint32_t i = 0; i < header.numNameSlots; i++)
+		{
+			if (!check_link(names[i].bone, header.numBones))
+				return -1;
+		}
+
+		for (uint32_t i = 0; i < header.numMeshes; i++)
+		{
+			const Mesh& m = meshes[i];
+			if (!check_range(m.startVertex, m.numVertices, header.numVertices) ||
+				!check_range(m.startIndex, m.numIndices, header.numIndices))
+				return -1;
+		}
+
+		for (uint32_t i = 0; i < header.numBones; i++)
+		{
+			const Bone& b = bones[i];
+			if (!check_link(b.parent, header.numBones) ||
+				!check_link(b.firstChild, header.numBones) ||
+				!check_link(b.nextSibling, header.numBones) ||
+				b.name < 0 || uint32_t(b.name) >= header.stringSize)
+				return -1;
+		}
+
+		// in chunked files the tracks are in the animation's chunk
+		for (uint32_t i = 0; i < header.numAnims && !chunked; i++)
+		{
+			if (!check_range(anims[i].tracks, anims[i].numTracks, header.numTracks))
+				return -1;
+		}
+
+		for (uint32_t i = 0; i < header.numChunks; i++)
+		{
+			const TFChunk& c = chunks[i];
+			uint64_t offsets[3];
+			if ((c.type != TFChunkGeometry || c.index >= header.numMeshes) &&
+				(c.type != TFChunkAnimation || c.index >= header.numAnims))
+				return -1;
+			if (c.start % TFModelAlignment != 0 || c.start < header.headSize ||
+				uint64_t(c.start) + c.size > header.fileSize ||
+				chunk_layout(c.type, c.count, offsets) > c.size)
+				return -1;
+		}
+
+		for (uint32_t i = 0; i < header.numTracks; i++)
+		{
+			const Track& t = tracks[i];
+			if (!check_range(t.transFrames, t.numTransFrames, header.numVectorFrames) ||
+				!check_range(t.rotFrames, t.numRotFrames, header.numQuatFrames) ||
+				!check_range(t.scaleFrames, t.numScaleFrames, header.numVectorFrames))
+				return -1;
+		}
+
+		model.vertices = reinterpret_cast<const SkinnedVertex*>(base + header.vertexStart);
+		model.numVertices = header.numVertices;
+		model.indices = reinterpret_cast<const uint32_t*>(base + header.indexStart);
+		model.numIndices = header.numIndices;
+		model.meshes = meshes;
+		model.numMeshes = header.numMeshes;
+		model.bones = bones;
+		model.numBones = header.numBones;
+		model.anims = anims;
+		model.numAnims = header.numAnims;
+		model.tracks = tracks;
+		model.numTracks = header.numTracks;
+		model.vectorFrames = reinterpret_cast<const VectorFrame*>(base + header.vectorFrameStart);
+		model.numVectorFrames = header.numVectorFrames;
+		model.quatFrames = reinterpret_cast<const QuaternionFrame*>(base + header.quatFrameStart);
+		model.numQuatFrames = header.numQuatFrames;
+		model.strings = strings;
+		model.stringSize = header.stringSize;
+		model.names = names;
+		model.numNameSlots = header.numNameSlots;
+		model.chunks = chunks;
+		model.numChunks = header.numChunks;
+		return 0;
+	}
+
+	int32_t validate_chunk(const void* data, const TFChunk& chunk, GeometryChunk& geometry)
+	{
+		geometry = GeometryChunk();
+		if (chunk.type != TFChunkGeometry)
+			return -1;
+
+		uint64_t offsets[3];
+		chunk_layout(chunk.type, chunk.count, offsets);
+		const uint8_t* base = reinterpret_cast<const uint8_t*>(data) + chunk.start;
+		const uint32_t* indices = reinterpret_cast<const uint32_t*>(base + offsets[1]);
+
+		for (uint32_t i = 0; i < chunk.count[1]; i++)
+		{
+			if (indices[i] >= chunk.count[0])
+				return -1;
+		}
+
+		geometry.vertices = reinterpret_cast<const SkinnedVertex*>(base + offsets[0]);
+		geometry.numVertices = chunk.count[0];
+		geometry.indices = indices;
+		geometry.numIndices = chunk.count[1];
+		return 0;
+	}
+
+	int32_t validate_chunk(const void* data, const TFChunk& chunk, AnimationChunk& animation)
+	{
+		animation = AnimationChunk();
+		if (chunk.type != TFChunkAnimation)
+			return -1;
+
+		uint64_t offsets[3];
+		chunk_layout(chunk.type, chunk.count, offsets);
+		const uint8_t* base = reinterpret_cast<const uint8_t*>(data) + chunk.start;
+		const Track* tracks = reinterpret_cast<const Track*>(base + offsets[0]);
+
+		for (uint32_t i = 0; i < chunk.count[0]; i++)
+		{
+			const Track& t = tracks[i];
+			if (!check_range(t.transFrames, t.numTransFrames, chunk.count[1]) ||
+				!check_range(t.rotFrames, t.numRotFrames, chunk.count[2]) ||
+				!check_range(t.scaleFrames, t.numScaleFrames, chunk.count[1]))
+				return -1;
+		}
+
+		animation.tracks = tracks;
+		animation.numTracks = chunk.count[0];
+		animation.vectorFrames = reinterpret_cast<const VectorFrame*>(base + offsets[1]);
+		animation.numVectorFrames = chunk.count[1];
+		animation.quatFrames = reinterpret_cast<const QuaternionFrame*>(base + offsets[2]);
+		animation.numQuatFrames = chunk.count[2];
+		return 0;
+	}
+
+	int32_t verify_header(const void* data)
+	{
+		const TFModel& header = *reinterpret_cast<const TFModel*>(data);
+		return header.headerCrc == header_crc(header) ? 0 : -1;
+	}
+
+	int32_t verify_section(const void* data, uint32_t section)
+	{
+		if (section >= TFSectionCount)
+			return -1;
+
+		const TFModel& header = *reinterpret_cast<const TFModel*>(data);
+		const uint8_t* start = reinterpret_cast<const uint8_t*>(data) + header.*sectionStarts[section];
+		return header.sectionCrc[section] == crc32c(start, header.sectionSize[section]) ? 0 : -1;
+	}
+
+	int32_t verify_chunk(const void* data, const TFChunk& chunk)
+	{
+		const uint8_t* start = reinterpret_cast<const uint8_t*>(data) + chunk.start;
+		return chunk.crc == crc32c(start, chunk.size) ? 0 : -1;
+	}
+
+	int32_t map_file(const char* filename, MappedFile& mapped)
+	{
+		mapped = MappedFile();
+
+#ifdef _WIN32
+		// sharing write access lets append_archive add to an archive
+		// that is mapped here
+		HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (INVALID_HANDLE_VALUE == file)
+			return -1;
+		mapped.file = file;
+
+		LARGE_INTEGER fileSize = {};
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			unmap_file(mapped);
+			return -1;
+		}
+		mapped.size = size_t(fileSize.QuadPart);
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (nullptr == mapping)
+		{
+			unmap_file(mapped);
+			return -1;
+		}
+		mapped.mapping = mapping;
+
+		mapped.data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		int fd = open(filename, O_RDONLY);
+		if (fd < 0)
+			return -1;
+
+		struct stat st;
+		if (0 != fstat(fd, &st) || st.st_size == 0)
+		{
+			close(fd);
+			return -1;
+		}
+		mapped.size = size_t(st.st_size);
+
+		// the mapping keeps its own reference to the file
+		void* p = mmap(nullptr, mapped.size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		mapped.data = p == MAP_FAILED ? nullptr : p;
+#endif
+
+		if (nullptr == mapped.data)
+		{
+			unmap_file(mapped);
+			return -1;
+		}
+		return 0;
+	}
+
+	void unmap_file(MappedFile& mapped)
+	{
+#ifdef _WIN32
+		if (nullptr != mapped.data)
+			UnmapViewOfFile(mapped.data);
+		if (nullptr != mapped.mapping)
+			CloseHandle(mapped.mapping);
+		if (nullptr != mapped.file && INVALID_HANDLE_VALUE != mapped.file)
+			CloseHandle(mapped.file);
+#else
+		if (nullptr != mapped.data)
+			munmap(const_cast<void*>(mapped.data), mapped.size);
+#endif
+		mapped = MappedFile();
+	}
+
+	int32_t open_model(const char* filename, MappedModel& mapped, bool verify)
+	{
+		mapped = MappedModel();
+
+		MappedFile file;
+		if (0 != map_file(filename, file))
+			return -1;
+		mapped.data = file.data;
+		mapped.size = file.size;
+		mapped.file = file.file;
+		mapped.mapping = file.mapping;
+
+		if (mapped.size < sizeof(TFModel) || (verify && 0 != verify_header(mapped.data)) ||
+			0 != validate_model(mapped.data, mapped.size, mapped.model))
+		{
+			close_model(mapped);
+			return -1;
+		}
+
+		mapped.verify = verify;
+		return 0;
+	}
+
+	int32_t require_section(MappedModel& mapped, uint32_t section)
+	{
+		if (!mapped.verify || section >= TFSectionCount || 0 != (mapped.verifiedSections & (1u << section)))
+			return section < TFSectionCount ? 0 : -1;
+
+		if (0 != verify_section(mapped.data, section))
+			return -1;
+
+		mapped.verifiedSections |= 1u << section;
+		return 0;
+	}
+
+	int32_t require_chunk(const MappedModel& mapped, uint32_t chunk)
+	{
+		if (chunk >= mapped.model.numChunks)
+			return -1;
+		return mapped.verify ? verify_chunk(mapped.data, mapped.model.chunks[chunk]) : 0;
+	}
+
+	void close_model(MappedModel& mapped)
+	{
+		MappedFile file = { mapped.data, mapped.size, mapped.file, mapped.mapping };
+		unmap_file(file);
+		mapped = MappedModel();
+	}
+
+	void prefetch_chunk(const MappedModel& mapped, uint32_t chunk)
+	{
+		if (nullptr == mapped.data || chunk >= mapped.model.numChunks)
+			return;
+
+		const TFChunk& c = mapped.model.chunks[chunk];
+		const char* start = reinterpret_cast<const char*>(mapped.data) + c.start;
+
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+		WIN32_MEMORY_RANGE_ENTRY range = { const_cast<char*>(start), c.size };
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+		(void)start;
+#endif
+#else
+		// madvise wants a page aligned address, chunks are only 4096 aligned
+		uintptr_t page = uintptr_t(sysconf(_SC_PAGESIZE));
+		uintptr_t first = reinterpret_cast<uintptr_t>(start) & ~(page - 1);
+		madvise(reinterpret_cast<void*>(first), reinterpret_cast<uintptr_t>(start) + c.size - first, MADV_WILLNEED);
+#endif
+	}
+}
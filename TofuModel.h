@@ -0,0 +1,177 @@
+#pragma once
+
+#include "TofuMesh.h"
+
+#include <cstring>
+
+namespace tofu
+{
+	// a converted scene as plain arrays, nothing is owned.
+	// Track frame indices, Animation::tracks, Bone::name and the parent and
+	// child links are indices into these arrays
+	struct ModelData
+	{
+		const SkinnedVertex*	vertices;
+		uint32_t				numVertices;
+		const uint32_t*			indices;
+		uint32_t				numIndices;
+		const Mesh*				meshes;
+		uint32_t				numMeshes;
+		const Bone*				bones;
+		uint32_t				numBones;
+		const Animation*		anims;
+		uint32_t				numAnims;
+		const Track*			tracks;
+		uint32_t				numTracks;
+		const VectorFrame*		vectorFrames;
+		uint32_t				numVectorFrames;
+		const QuaternionFrame*	quatFrames;
+		uint32_t				numQuatFrames;
+		const char*				strings;
+		uint32_t				stringSize;
+		const TFNameSlot*		names;
+		uint32_t				numNameSlots;
+		const TFChunk*			chunks;
+		uint32_t				numChunks;
+	};
+
+	// the contents of a TFChunkGeometry chunk, indices are relative to vertices
+	struct GeometryChunk
+	{
+		const SkinnedVertex*	vertices;
+		uint32_t				numVertices;
+		const uint32_t*			indices;
+		uint32_t				numIndices;
+	};
+
+	// the contents of a TFChunkAnimation chunk, frame indices are relative to the chunk
+	struct AnimationChunk
+	{
+		const Track*			tracks;
+		uint32_t				numTracks;
+		const VectorFrame*		vectorFrames;
+		uint32_t				numVectorFrames;
+		const QuaternionFrame*	quatFrames;
+		uint32_t				numQuatFrames;
+	};
+
+	// a name that is not necessarily null terminated, for lookups that
+	// should not allocate
+	struct StringView
+	{
+		const char*	data;
+		size_t		size;
+
+		StringView() : data(""), size(0) {}
+		StringView(const char* str) : data(str), size(strlen(str)) {}
+		StringView(const char* str, size_t length) : data(str), size(length) {}
+
+		bool operator == (const StringView& other) const
+		{
+			return size == other.size && 0 == memcmp(data, other.data, size);
+		}
+	};
+
+	// XXH64 of size bytes
+	uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
+
+	inline uint64_t hash_name(StringView name)
+	{
+		return hash_bytes(name.data, name.size);
+	}
+
+	// slots for a name table of count names, at most half of them used
+	uint32_t name_table_size(uint32_t count);
+
+	// fills the numSlots slots with the hashes of the bone names, numSlots
+	// from name_table_size. Returns -1 when two bones share a name or hash
+	int32_t build_name_table(const Bone* bones, uint32_t numBones, const char* strings,
+		TFNameSlot* slots, uint32_t numSlots);
+
+	// the bone named by hash, or -1
+	int32_t find_name(const TFNameSlot* slots, uint32_t numSlots, uint64_t hash);
+
+	// CRC32C (Castagnoli) of size bytes continuing from crc, uses the SSE4.2
+	// instruction when the CPU has it
+	uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0);
+
+	// fills in the offsets, counts, sizes, checksums and file size of a
+	// TFModel header for model. Fails when the file would not fit the 32 bit
+	// offsets of the format
+	int32_t layout_model(const ModelData& model, TFModel& header);
+
+	// writes model as a TFModel file, returns 0 on success and -1 without
+	// writing anything when the model is too large for the format
+	int32_t write_model(const char* filename, const ModelData& model);
+
+	// writes model in the chunked layout, see TFModelChunked. The coarse LOD
+	// clusters vertices on a grid with coarseCells cells along the longest
+	// side of each mesh. Returns 0 on success
+	int32_t write_model_chunked(const char* filename, const ModelData& model, uint32_t coarseCells = 16);
+
+	// checks the header, the section bounds and alignment, the chunk table
+	// and the indices stored in meshes, bones, animations and tracks, then
+	// points model at the sections inside data. Index buffer and chunk
+	// contents are not read, so only the head of a chunked file is touched.
+	// data must be aligned to TFModelAlignment, returns 0 on success
+	int32_t validate_model(const void* data, size_t size, ModelData& model);
+
+	// checks a chunk of a validated model and points the result into it,
+	// data is the start of the file. Geometry chunks have every index checked
+	int32_t validate_chunk(const void* data, const TFChunk& chunk, GeometryChunk& geometry);
+	int32_t validate_chunk(const void* data, const TFChunk& chunk, AnimationChunk& animation);
+
+	// compare checksums in a validated file, data is the start of the file.
+	// Kept apart from validation so files from trusted storage skip the cost
+	// and the rest pay for the sections they read. Return 0 on a match
+	int32_t verify_header(const void* data);
+	int32_t verify_section(const void* data, uint32_t section);
+	int32_t verify_chunk(const void* data, const TFChunk& chunk);
+
+	// a whole file mapped read only, pages are shared between processes
+	// mapping the same file
+	struct MappedFile
+	{
+		const void*	data;
+		size_t		size;
+		void*		file;		// HANDLE on Windows, unused elsewhere
+		void*		mapping;	// HANDLE on Windows, unused elsewhere
+	};
+
+	// fails on empty files, returns 0 on success
+	int32_t map_file(const char* filename, MappedFile& mapped);
+
+	// safe to call on an unmapped or failed MappedFile
+	void unmap_file(MappedFile& mapped);
+
+	// a TFModel file mapped read only, pages are shared between processes
+	// mapping the same file. model points into the mapping until close_model
+	struct MappedModel
+	{
+		ModelData	model;
+		const void*	data;
+		size_t		size;
+		void*		file;		// HANDLE on Windows, unused elsewhere
+		void*		mapping;	// HANDLE on Windows, unused elsewhere
+		bool		verify;
+		uint32_t	verifiedSections;	// bit per TFSection
+	};
+
+	// maps and validates filename, returns 0 on success. With verify the
+	// header checksum is checked here and the sections by require_section
+	int32_t open_model(const char* filename, MappedModel& mapped, bool verify = false);
+
+	// returns 0 when a section can be used: its checksum matches, or was
+	// checked before, or mapped was opened without verify
+	int32_t require_section(MappedModel& mapped, uint32_t section);
+
+	// the same for a chunk, checked on every call
+	int32_t require_chunk(const MappedModel& mapped, uint32_t chunk);
+
+	// safe to call on a closed or failed MappedModel
+	void close_model(MappedModel& mapped);
+
+	// asks the OS to start reading a chunk in the background, so touching it
+	// later does not stall on a network mounted file
+	void prefetch_chunk(const MappedModel& mapped, uint32_t chunk);
+}